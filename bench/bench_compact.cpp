@@ -0,0 +1,81 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench_rsm.h"
+#include "recursive_shared_mutex.h"
+#include "rsm_compact.h"
+
+#include <fstream>
+#include <memory>
+
+#include <unistd.h>
+
+const size_t COMPACT_INSTANCES = 10000000;
+// 10M recursive_shared_mutex take gigabytes, this many are allocated and the result scaled up
+const size_t FULL_SIZE_INSTANCES = 1000000;
+const uint64_t COMPACT_ITERATIONS = 1000000;
+
+// resident set size of the process in bytes
+static uint64_t bench_resident_bytes()
+{
+    std::ifstream statm("/proc/self/statm");
+    uint64_t size = 0;
+    uint64_t resident = 0;
+    statm >> size >> resident;
+    return resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+}
+
+// allocates instances mutexes, locks every one of them once so their memory is really touched and reports
+// what 10M of them cost
+template <class Mutex>
+void bench_footprint(const std::string &name, const size_t &instances)
+{
+    const uint64_t resident_before = bench_resident_bytes();
+    std::unique_ptr<Mutex[]> mutexes(new Mutex[instances]);
+    for (size_t i = 0; i < instances; ++i)
+    {
+        mutexes[i].lock_shared();
+        mutexes[i].unlock_shared();
+    }
+    const double scale = double(COMPACT_INSTANCES) / instances;
+    const std::string bench = name + " 10M instances";
+    bench_report(bench, "sizeof", double(sizeof(Mutex)), "bytes");
+    bench_report(bench, "resident memory", (bench_resident_bytes() - resident_before) * scale / (1024 * 1024), "MiB");
+}
+
+// uncontended lock and unlock by one thread, the price of finding the per thread counts in the thread local
+// tables instead of the mutex
+template <class Mutex>
+void bench_uncontended(const std::string &name)
+{
+    Mutex mutex;
+    const int64_t begin_ns = rsm_steady_now_ns();
+    for (uint64_t i = 0; i < COMPACT_ITERATIONS; ++i)
+    {
+        mutex.lock_shared();
+        mutex.unlock_shared();
+    }
+    const int64_t shared_ns = rsm_steady_now_ns() - begin_ns;
+    for (uint64_t i = 0; i < COMPACT_ITERATIONS; ++i)
+    {
+        mutex.lock();
+        mutex.unlock();
+    }
+    const int64_t exclusive_ns = rsm_steady_now_ns() - begin_ns - shared_ns;
+    bench_report(name, "ns per lock_shared/unlock_shared", double(shared_ns) / COMPACT_ITERATIONS, "ns");
+    bench_report(name, "ns per lock/unlock", double(exclusive_ns) / COMPACT_ITERATIONS, "ns");
+}
+
+BENCH_CASE(compact_footprint)
+{
+    bench_footprint<rsm_compact_mutex>("compact rsm_compact_mutex", COMPACT_INSTANCES);
+    bench_footprint<recursive_shared_mutex>("compact recursive_shared_mutex", FULL_SIZE_INSTANCES);
+}
+
+BENCH_CASE(compact_uncontended)
+{
+    bench_uncontended<rsm_compact_mutex>("compact rsm_compact_mutex");
+    bench_uncontended<recursive_shared_mutex>("compact recursive_shared_mutex");
+}
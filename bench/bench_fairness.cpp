@@ -0,0 +1,70 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench_writer_wait.h"
+#include "recursive_shared_mutex.h"
+
+const uint64_t FAIRNESS_ITERATIONS = 10000;
+
+// every thread records how long each lock() or lock_shared() call took. the policies trade shared
+// throughput against how long writers, or with writer preference readers, have to wait
+template <class Mutex>
+void bench_fairness(const std::string &name, const size_t &writers, const size_t &readers)
+{
+    Mutex mutex;
+    std::vector<std::vector<int64_t> > waits(writers + readers);
+    const int64_t elapsed_ns = bench_run_threads(writers + readers, [&mutex, &writers, &waits](size_t index) {
+        std::vector<int64_t> &our_waits = waits[index];
+        our_waits.reserve(FAIRNESS_ITERATIONS);
+        for (uint64_t i = 0; i < FAIRNESS_ITERATIONS; ++i)
+        {
+            const int64_t begin_ns = bench_now_ns();
+            if (index < writers)
+            {
+                mutex.lock();
+                our_waits.push_back(bench_now_ns() - begin_ns);
+                bench_busy_work(50);
+                mutex.unlock();
+            }
+            else
+            {
+                mutex.lock_shared();
+                our_waits.push_back(bench_now_ns() - begin_ns);
+                bench_busy_work(200);
+                mutex.unlock_shared();
+            }
+            bench_busy_work(50);
+        }
+    });
+
+    std::vector<int64_t> writer_waits;
+    std::vector<int64_t> reader_waits;
+    for (size_t i = 0; i < waits.size(); ++i)
+    {
+        std::vector<int64_t> &all = (i < writers) ? writer_waits : reader_waits;
+        all.insert(all.end(), waits[i].begin(), waits[i].end());
+    }
+    const std::string bench = name + " " + std::to_string(writers) + "w/" + std::to_string(readers) + "r";
+    bench_report(bench, "ns per operation", double(elapsed_ns) / ((writers + readers) * FAIRNESS_ITERATIONS), "ns");
+    bench_report(bench, "p99 writer wait", double(bench_percentile(writer_waits, 0.99)), "ns");
+    bench_report(bench, "max writer wait", double(writer_waits.empty() ? 0 : writer_waits.back()), "ns");
+    bench_report(bench, "p99 reader wait", double(bench_percentile(reader_waits, 0.99)), "ns");
+    bench_report(bench, "max reader wait", double(reader_waits.empty() ? 0 : reader_waits.back()), "ns");
+}
+
+BENCH_CASE(fairness_phase_fair)
+{
+    bench_fairness<phase_fair_recursive_shared_mutex>("fairness phase_fair", 2, 6);
+}
+
+BENCH_CASE(fairness_reader_preferring)
+{
+    bench_fairness<reader_preferring_recursive_shared_mutex>("fairness reader_preferring", 2, 6);
+}
+
+BENCH_CASE(fairness_writer_preferring)
+{
+    bench_fairness<writer_preferring_recursive_shared_mutex>("fairness writer_preferring", 2, 6);
+}
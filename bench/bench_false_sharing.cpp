@@ -0,0 +1,68 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench_rsm.h"
+#include "recursive_shared_mutex.h"
+#include "rsm_compact.h"
+#include "rsm_padded.h"
+
+#include <memory>
+
+const uint64_t FALSE_SHARING_ITERATIONS = 500000;
+
+// Every thread takes and releases its own mutex of a table in a loop, no two threads ever use the same one.
+// Any slow down with more threads comes from neighbouring mutexes sharing cache lines. mutex_at(index) returns
+// the mutex of thread index.
+template <class MutexAt>
+void bench_false_sharing(const std::string &name, const bool &exclusive, const MutexAt &mutex_at)
+{
+    for (const size_t &threads : bench_thread_counts())
+    {
+        const int64_t elapsed_ns = bench_run_threads(threads, [&mutex_at, &exclusive](size_t index) {
+            auto &mutex = mutex_at(index);
+            for (uint64_t i = 0; i < FALSE_SHARING_ITERATIONS; ++i)
+            {
+                if (exclusive)
+                {
+                    mutex.lock();
+                    mutex.unlock();
+                }
+                else
+                {
+                    mutex.lock_shared();
+                    mutex.unlock_shared();
+                }
+            }
+        });
+        const std::string bench = name + " " + std::to_string(threads) + " threads";
+        bench_report(bench, "ns per lock/unlock per thread", double(elapsed_ns) / FALSE_SHARING_ITERATIONS, "ns");
+    }
+}
+
+// a plain new[] array next to an rsm_padded_array of the same mutexes
+template <class Mutex>
+void bench_false_sharing_tables(const std::string &name, const bool &exclusive)
+{
+    const size_t count = bench_thread_counts().back();
+    std::unique_ptr<Mutex[]> packed(new Mutex[count]);
+    rsm_padded_array<Mutex> padded(count);
+    bench_false_sharing(name + " new[]", exclusive, [&packed](size_t index) -> Mutex & { return packed[index]; });
+    bench_false_sharing(
+        name + " rsm_padded_array", exclusive, [&padded](size_t index) -> Mutex & { return padded[index]; });
+}
+
+// eight rsm_compact_mutex fit in one cache line, neighbouring recursive_shared_mutex in new[] share the line
+// where one ends and the next begins
+BENCH_CASE(false_sharing_shared)
+{
+    bench_false_sharing_tables<rsm_compact_mutex>("false_sharing shared rsm_compact_mutex", false);
+    bench_false_sharing_tables<recursive_shared_mutex>("false_sharing shared recursive_shared_mutex", false);
+}
+
+BENCH_CASE(false_sharing_exclusive)
+{
+    bench_false_sharing_tables<rsm_compact_mutex>("false_sharing exclusive rsm_compact_mutex", true);
+    bench_false_sharing_tables<recursive_shared_mutex>("false_sharing exclusive recursive_shared_mutex", true);
+}
@@ -0,0 +1,91 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench_rsm.h"
+#include "recursive_shared_mutex.h"
+#include "rsm_hash_map.h"
+
+#include <mutex>
+#include <random>
+#include <unordered_map>
+
+const uint64_t HASH_MAP_OPERATIONS = 200000;
+const uint64_t HASH_MAP_KEYS = 100000;
+
+// the baseline, one std::unordered_map behind one recursive_shared_mutex
+class global_mutex_map
+{
+private:
+    mutable recursive_shared_mutex _mutex;
+    std::unordered_map<uint64_t, uint64_t> _map;
+
+public:
+    bool find(const uint64_t &key, uint64_t &value) const
+    {
+        std::shared_lock<recursive_shared_mutex> _lock(_mutex);
+        auto iter = _map.find(key);
+        if (iter == _map.end())
+        {
+            return false;
+        }
+        value = iter->second;
+        return true;
+    }
+
+    bool insert_or_assign(const uint64_t &key, const uint64_t &value)
+    {
+        std::lock_guard<recursive_shared_mutex> _lock(_mutex);
+        const bool inserted = (_map.find(key) == _map.end());
+        _map[key] = value;
+        return inserted;
+    }
+};
+
+// Lookups and writes of random keys from one thread up to one per core, one in write_interval operations
+// is a write. Half of the keys are there before the clock starts.
+template <class Map>
+void bench_hash_map(const std::string &name, const uint64_t &write_interval)
+{
+    for (const size_t &threads : bench_thread_counts())
+    {
+        Map map;
+        for (uint64_t key = 0; key < HASH_MAP_KEYS; key += 2)
+        {
+            map.insert_or_assign(key, key);
+        }
+        const int64_t elapsed_ns = bench_run_threads(threads, [&map, &write_interval](size_t index) {
+            std::minstd_rand random(static_cast<uint32_t>(index + 1));
+            uint64_t found = 0;
+            for (uint64_t i = 0; i < HASH_MAP_OPERATIONS; ++i)
+            {
+                const uint64_t key = random() % HASH_MAP_KEYS;
+                if (i % write_interval == 0)
+                {
+                    map.insert_or_assign(key, i);
+                }
+                else
+                {
+                    uint64_t value = 0;
+                    found += map.find(key, value) ? 1 : 0;
+                }
+            }
+            bench_busy_work(found % 2);
+        });
+        const std::string bench = name + " " + std::to_string(threads) + " threads";
+        bench_report(bench, "operations per second", double(threads * HASH_MAP_OPERATIONS) * 1e9 / elapsed_ns, "ops/s");
+    }
+}
+
+BENCH_CASE(hash_map_90_10)
+{
+    bench_hash_map<global_mutex_map>("hash_map 90/10 global_mutex", 10);
+    bench_hash_map<rsm_hash_map<uint64_t, uint64_t> >("hash_map 90/10 rsm_hash_map", 10);
+}
+
+BENCH_CASE(hash_map_99_1)
+{
+    bench_hash_map<global_mutex_map>("hash_map 99/1 global_mutex", 100);
+    bench_hash_map<rsm_hash_map<uint64_t, uint64_t> >("hash_map 99/1 rsm_hash_map", 100);
+}
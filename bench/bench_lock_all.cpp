@@ -0,0 +1,91 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench_rsm.h"
+#include "recursive_shared_mutex.h"
+#include "rsm_lock_all.h"
+#include "rsm_padded.h"
+
+#include <algorithm>
+#include <random>
+
+const uint64_t LOCK_ALL_TRANSACTIONS = 100000;
+const size_t LOCK_ALL_SHARDS_PER_TRANSACTION = 3;
+
+typedef rsm_lock_request<recursive_shared_mutex> bench_request;
+
+// the naive way, sort by address and wait for each mutex in turn
+static void ordered_lock(bench_request *requests, const size_t &count)
+{
+    std::sort(requests, requests + count,
+        [](const bench_request &a, const bench_request &b) { return a.mutex < b.mutex; });
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (requests[i].mode == rsm_lock_mode::shared)
+        {
+            requests[i].mutex->lock_shared();
+        }
+        else
+        {
+            requests[i].mutex->lock();
+        }
+    }
+}
+
+// Cross shard transactions from one thread up to one per core. Every transaction writes one shard and
+// reads two others picked at random out of shards, and holds them for a short while. The requests are
+// taken either in address order one after another or with rsm_lock_all().
+template <bool LockAll>
+void bench_lock_all_transactions(const std::string &name, const size_t &shards)
+{
+    for (const size_t &threads : bench_thread_counts())
+    {
+        rsm_padded_array<recursive_shared_mutex> mutexes(shards);
+        const int64_t elapsed_ns = bench_run_threads(threads, [&mutexes, &shards](size_t index) {
+            std::minstd_rand random(static_cast<uint32_t>(index + 1));
+            std::vector<size_t> picked(shards);
+            for (size_t i = 0; i < shards; ++i)
+            {
+                picked[i] = i;
+            }
+            bench_request requests[LOCK_ALL_SHARDS_PER_TRANSACTION];
+            for (uint64_t i = 0; i < LOCK_ALL_TRANSACTIONS; ++i)
+            {
+                // the first few of a partial shuffle are distinct shards
+                for (size_t j = 0; j < LOCK_ALL_SHARDS_PER_TRANSACTION; ++j)
+                {
+                    std::swap(picked[j], picked[j + random() % (shards - j)]);
+                    requests[j] = (j == 0) ? rsm_exclusive(mutexes[picked[j]]) : rsm_shared(mutexes[picked[j]]);
+                }
+                if (LockAll)
+                {
+                    rsm_lock_all(requests, LOCK_ALL_SHARDS_PER_TRANSACTION);
+                }
+                else
+                {
+                    ordered_lock(requests, LOCK_ALL_SHARDS_PER_TRANSACTION);
+                }
+                bench_busy_work(20);
+                rsm_unlock_all(requests, LOCK_ALL_SHARDS_PER_TRANSACTION);
+            }
+        });
+        const std::string bench = name + " " + std::to_string(threads) + " threads";
+        bench_report(
+            bench, "transactions per second", double(threads * LOCK_ALL_TRANSACTIONS) * 1e9 / elapsed_ns, "tx/s");
+    }
+}
+
+// with few shards most transactions collide, with many they rarely do
+BENCH_CASE(lock_all_8_shards)
+{
+    bench_lock_all_transactions<false>("lock_all 8_shards ordered", 8);
+    bench_lock_all_transactions<true>("lock_all 8_shards rsm_lock_all", 8);
+}
+
+BENCH_CASE(lock_all_64_shards)
+{
+    bench_lock_all_transactions<false>("lock_all 64_shards ordered", 64);
+    bench_lock_all_transactions<true>("lock_all 64_shards rsm_lock_all", 64);
+}
@@ -0,0 +1,49 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench_rsm.h"
+#include "recursive_shared_mutex.h"
+#include "rsm_numa.h"
+
+const uint64_t NUMA_ITERATIONS = 20000;
+
+// Writers on nodes fake_nodes apart contend for one mutex, every thread is told it runs on node
+// index % fake_nodes. Reports how often exclusive ownership moved to another node, on a real multi
+// socket machine each of those moves the lock and the protected data across the interconnect.
+template <class Mutex>
+void bench_numa_handoffs(const std::string &name, const size_t &threads, const size_t &fake_nodes)
+{
+    Mutex mutex;
+    size_t last_node = RSM_NUMA_MAX_NODES;
+    uint64_t node_changes = 0;
+    const int64_t elapsed_ns =
+        bench_run_threads(threads, [&mutex, &fake_nodes, &last_node, &node_changes](size_t index) {
+            const size_t node = index % fake_nodes;
+            rsm_numa_set_thread_node(static_cast<int>(node));
+            for (uint64_t i = 0; i < NUMA_ITERATIONS; ++i)
+            {
+                mutex.lock();
+                if (node != last_node)
+                {
+                    node_changes++;
+                    last_node = node;
+                }
+                bench_busy_work(50);
+                mutex.unlock();
+                bench_busy_work(50);
+            }
+        });
+    const std::string bench = name + " " + std::to_string(threads) + " threads/" + std::to_string(fake_nodes) + " nodes";
+    bench_report(bench, "ns per lock", double(elapsed_ns) / (threads * NUMA_ITERATIONS), "ns");
+    bench_report(bench, "node changes per 1000 locks", 1000.0 * node_changes / (threads * NUMA_ITERATIONS), "");
+}
+
+BENCH_CASE(numa_cohort)
+{
+    bench_numa_handoffs<recursive_shared_mutex>("numa fifo", 8, 2);
+    bench_numa_handoffs<numa_recursive_shared_mutex>("numa cohort", 8, 2);
+    bench_numa_handoffs<recursive_shared_mutex>("numa fifo", 8, 4);
+    bench_numa_handoffs<numa_recursive_shared_mutex>("numa cohort", 8, 4);
+}
@@ -0,0 +1,58 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench_rsm.h"
+#include "recursive_shared_mutex.h"
+
+#include <chrono>
+#include <memory>
+
+static const uint64_t CYCLES = 1000000;
+
+// lock_shared then unlock_shared held_count mutexes CYCLES times, the first cycle is not measured
+// so a one time allocation of an overflow table does not count
+static void bench_shared_cycles(const char *name, const size_t &held_count)
+{
+    std::unique_ptr<recursive_shared_mutex[]> mutexes(new recursive_shared_mutex[held_count]);
+    auto cycle = [&mutexes, &held_count] {
+        for (size_t i = 0; i < held_count; ++i)
+        {
+            mutexes[i].lock_shared();
+        }
+        // recursive shared lock of every mutex we hold
+        for (size_t i = 0; i < held_count; ++i)
+        {
+            mutexes[i].lock_shared();
+            mutexes[i].unlock_shared();
+        }
+        for (size_t i = 0; i < held_count; ++i)
+        {
+            mutexes[i].unlock_shared();
+        }
+    };
+    cycle();
+
+    const uint64_t allocations_before = bench_allocation_count();
+    const auto begin = std::chrono::steady_clock::now();
+    for (uint64_t n = 0; n < CYCLES; ++n)
+    {
+        cycle();
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - begin;
+    const uint64_t allocations = bench_allocation_count() - allocations_before;
+
+    const double lock_count = double(CYCLES) * held_count * 2;
+    bench_report(name, "ns per lock/unlock pair",
+        std::chrono::duration<double, std::nano>(elapsed).count() / lock_count, "ns");
+    bench_report(name, "allocations per lock/unlock pair", double(allocations) / lock_count, "allocs");
+}
+
+BENCH_CASE(owner_table_single_mutex) { bench_shared_cycles("owner_table_single_mutex", 1); }
+
+// fits in the inline slots of the thread local owner table
+BENCH_CASE(owner_table_8_mutexes) { bench_shared_cycles("owner_table_8_mutexes", 8); }
+
+// more mutexes than the inline slots hold, uses the overflow table
+BENCH_CASE(owner_table_64_mutexes) { bench_shared_cycles("owner_table_64_mutexes", 64); }
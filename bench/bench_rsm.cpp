@@ -0,0 +1,124 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench_rsm.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <thread>
+
+#include <sys/resource.h>
+
+static std::atomic<uint64_t> allocation_count(0);
+
+void *operator new(size_t size)
+{
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    void *ptr = std::malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+
+uint64_t bench_allocation_count() { return allocation_count.load(std::memory_order_relaxed); }
+
+void bench_context_switches(uint64_t &voluntary, uint64_t &involuntary)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    voluntary = usage.ru_nvcsw;
+    involuntary = usage.ru_nivcsw;
+}
+
+std::vector<bench_case> &bench_cases()
+{
+    static std::vector<bench_case> cases;
+    return cases;
+}
+
+std::vector<size_t> bench_thread_counts()
+{
+    const size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<size_t> counts;
+    for (size_t count = 1; count < cores; count *= 2)
+    {
+        counts.push_back(count);
+    }
+    counts.push_back(cores);
+    return counts;
+}
+
+int64_t bench_run_threads(const size_t &thread_count, const std::function<void(size_t)> &function)
+{
+    std::atomic<bool> start(false);
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i)
+    {
+        threads.emplace_back([&start, &function, i] {
+            while (!start.load(std::memory_order_acquire))
+            {
+                std::this_thread::yield();
+            }
+            function(i);
+        });
+    }
+    const auto begin = std::chrono::steady_clock::now();
+    start.store(true, std::memory_order_release);
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+}
+
+void bench_busy_work(const uint64_t &rounds)
+{
+    volatile uint64_t sink = 0;
+    for (uint64_t i = 0; i < rounds; ++i)
+    {
+        sink = sink + i;
+    }
+}
+
+int64_t bench_percentile(std::vector<int64_t> &samples, const double &fraction)
+{
+    if (samples.empty())
+    {
+        return 0;
+    }
+    std::sort(samples.begin(), samples.end());
+    const size_t index = std::min(samples.size() - 1, static_cast<size_t>(fraction * samples.size()));
+    return samples[index];
+}
+
+void bench_report(const std::string &bench, const std::string &metric, const double &value, const std::string &unit)
+{
+    std::printf("%-40s %-40s %14.2f %s\n", bench.c_str(), metric.c_str(), value, unit.c_str());
+    std::fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *filter = (argc > 1) ? argv[1] : "";
+    for (const bench_case &bench : bench_cases())
+    {
+        if (std::strstr(bench.name, filter) != nullptr)
+        {
+            bench.function();
+        }
+    }
+    return 0;
+}
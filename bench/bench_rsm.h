@@ -0,0 +1,60 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BENCH_RSM_H
+#define BENCH_RSM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+typedef void (*bench_function)();
+
+struct bench_case
+{
+    const char *name;
+    bench_function function;
+};
+
+std::vector<bench_case> &bench_cases();
+
+struct bench_registrar
+{
+    bench_registrar(const char *name, bench_function function) { bench_cases().push_back({name, function}); }
+};
+
+// define and register a benchmark, bench_rsm runs every registered benchmark whose name
+// contains the filter given on the command line
+#define BENCH_CASE(name)                                    \
+    static void name();                                     \
+    static bench_registrar name##_registrar(#name, name); \
+    static void name()
+
+// number of calls to operator new made by any thread since the program started
+uint64_t bench_allocation_count();
+
+// voluntary and involuntary context switches of all threads of this process so far
+void bench_context_switches(uint64_t &voluntary, uint64_t &involuntary);
+
+// thread counts to run scaling benchmarks with, powers of 2 up to and including the number of cores
+std::vector<size_t> bench_thread_counts();
+
+// run function(thread_index) on thread_count threads that all start at the same time
+// @return elapsed nanoseconds from the start until the last thread finished
+int64_t bench_run_threads(const size_t &thread_count, const std::function<void(size_t)> &function);
+
+// keep the cpu busy for a little while without touching shared memory
+void bench_busy_work(const uint64_t &rounds);
+
+// the value below which fraction of the samples fall, sorts samples in place
+// @param fraction between 0 and 1, 0.99 for the 99th percentile
+int64_t bench_percentile(std::vector<int64_t> &samples, const double &fraction);
+
+// print one result line, these are meant to be easy to grep and paste into a spreadsheet
+void bench_report(const std::string &bench, const std::string &metric, const double &value, const std::string &unit);
+
+#endif // BENCH_RSM_H
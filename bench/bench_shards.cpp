@@ -0,0 +1,58 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench_rsm.h"
+#include "recursive_shared_mutex.h"
+
+const uint64_t SHARD_ITERATIONS = 200000;
+
+// Shared ownership throughput from one thread up to one per core. Every thread takes and releases
+// shared ownership in a loop with a short read section, one in writer_interval iterations takes
+// exclusive ownership instead (0 for none). With the reader count in the state word every reader
+// writes the same cache line, with reader shards the readers on different cores do not.
+template <class Mutex>
+void bench_shard_scaling(const std::string &name, const uint64_t &writer_interval)
+{
+    for (const size_t &threads : bench_thread_counts())
+    {
+        Mutex mutex;
+        const int64_t elapsed_ns = bench_run_threads(threads, [&mutex, &writer_interval](size_t index) {
+            for (uint64_t i = 0; i < SHARD_ITERATIONS; ++i)
+            {
+                if (writer_interval != 0 && (i + index) % writer_interval == 0)
+                {
+                    mutex.lock();
+                    bench_busy_work(10);
+                    mutex.unlock();
+                }
+                else
+                {
+                    mutex.lock_shared();
+                    bench_busy_work(10);
+                    mutex.unlock_shared();
+                }
+            }
+        });
+        const std::string bench = name + " " + std::to_string(threads) + " threads";
+        bench_report(bench, "operations per second", double(threads * SHARD_ITERATIONS) * 1e9 / elapsed_ns, "ops/s");
+    }
+}
+
+BENCH_CASE(shards_read_only)
+{
+    bench_shard_scaling<recursive_shared_mutex>("shards read_only state_word", 0);
+    bench_shard_scaling<rsm_sharded_mutex<8> >("shards read_only 8_shards", 0);
+    bench_shard_scaling<sharded_recursive_shared_mutex>(
+        "shards read_only " + std::to_string(RSM_READER_SHARDS) + "_shards", 0);
+}
+
+// writers have to count every shard, more shards make them slower
+BENCH_CASE(shards_one_percent_writes)
+{
+    bench_shard_scaling<recursive_shared_mutex>("shards 1%_writes state_word", 100);
+    bench_shard_scaling<rsm_sharded_mutex<8> >("shards 1%_writes 8_shards", 100);
+    bench_shard_scaling<sharded_recursive_shared_mutex>(
+        "shards 1%_writes " + std::to_string(RSM_READER_SHARDS) + "_shards", 100);
+}
@@ -0,0 +1,11 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench_wakeups.h"
+#include "recursive_shared_mutex.h"
+
+BENCH_CASE(wakeups_writers_only) { bench_transfers<recursive_shared_mutex>("wakeups rsm", 4, 0); }
+
+BENCH_CASE(wakeups_mixed) { bench_transfers<recursive_shared_mutex>("wakeups rsm", 2, 6); }
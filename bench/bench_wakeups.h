@@ -0,0 +1,56 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BENCH_WAKEUPS_H
+#define BENCH_WAKEUPS_H
+
+#include "bench_rsm.h"
+
+#include <string>
+
+const uint64_t WRITER_ITERATIONS = 20000;
+const uint64_t READER_ITERATIONS = 20000;
+
+// writers and readers hammer one mutex, report how many times a thread had to go to sleep
+// for each exclusive ownership transfer. exp_recursive_shared_mutex is the previous implementation
+// that wakes every waiter on each release
+template <class Mutex>
+void bench_transfers(const std::string &name, const size_t &writers, const size_t &readers)
+{
+    Mutex mutex;
+    uint64_t voluntary_before, involuntary_before, voluntary_after, involuntary_after;
+    bench_context_switches(voluntary_before, involuntary_before);
+    const int64_t elapsed_ns = bench_run_threads(writers + readers, [&mutex, &writers](size_t index) {
+        if (index < writers)
+        {
+            for (uint64_t i = 0; i < WRITER_ITERATIONS; ++i)
+            {
+                mutex.lock();
+                bench_busy_work(50);
+                mutex.unlock();
+            }
+        }
+        else
+        {
+            for (uint64_t i = 0; i < READER_ITERATIONS; ++i)
+            {
+                mutex.lock_shared();
+                bench_busy_work(50);
+                mutex.unlock_shared();
+            }
+        }
+    });
+    bench_context_switches(voluntary_after, involuntary_after);
+
+    const std::string bench = name + " " + std::to_string(writers) + "w/" + std::to_string(readers) + "r";
+    const double transfers = double(writers * WRITER_ITERATIONS);
+    bench_report(bench, "voluntary switches per exclusive transfer", (voluntary_after - voluntary_before) / transfers,
+        "switches");
+    bench_report(bench, "involuntary switches per exclusive transfer",
+        (involuntary_after - involuntary_before) / transfers, "switches");
+    bench_report(bench, "ns per operation", double(elapsed_ns) / (transfers + readers * READER_ITERATIONS), "ns");
+}
+
+#endif // BENCH_WAKEUPS_H
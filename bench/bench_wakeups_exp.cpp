@@ -0,0 +1,14 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench_wakeups.h"
+#include "exp_recursive_shared_mutex.h"
+
+// exp_recursive_shared_mutex still has the original gates that wake every waiter on each release,
+// run the same workloads on it for comparison
+
+BENCH_CASE(wakeups_writers_only_exp) { bench_transfers<exp_recursive_shared_mutex>("wakeups exp_rsm", 4, 0); }
+
+BENCH_CASE(wakeups_mixed_exp) { bench_transfers<exp_recursive_shared_mutex>("wakeups exp_rsm", 2, 6); }
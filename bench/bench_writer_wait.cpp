@@ -0,0 +1,11 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench_writer_wait.h"
+#include "recursive_shared_mutex.h"
+
+BENCH_CASE(writer_wait_writers_only) { bench_writer_wait<recursive_shared_mutex>("writer wait rsm", 4, 0); }
+
+BENCH_CASE(writer_wait_mixed) { bench_writer_wait<recursive_shared_mutex>("writer wait rsm", 4, 4); }
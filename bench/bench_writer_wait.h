@@ -0,0 +1,68 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BENCH_WRITER_WAIT_H
+#define BENCH_WRITER_WAIT_H
+
+#include "bench_rsm.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+const uint64_t WAIT_WRITER_ITERATIONS = 5000;
+const uint64_t WAIT_READER_ITERATIONS = 20000;
+
+inline int64_t bench_now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// writers and readers hammer one mutex, every writer records how long each lock() call took.
+// a high p99 compared to the median means some writers are passed over again and again
+template <class Mutex>
+void bench_writer_wait(const std::string &name, const size_t &writers, const size_t &readers)
+{
+    Mutex mutex;
+    std::vector<std::vector<int64_t> > waits(writers);
+    bench_run_threads(writers + readers, [&mutex, &writers, &waits](size_t index) {
+        if (index < writers)
+        {
+            std::vector<int64_t> &our_waits = waits[index];
+            our_waits.reserve(WAIT_WRITER_ITERATIONS);
+            for (uint64_t i = 0; i < WAIT_WRITER_ITERATIONS; ++i)
+            {
+                const int64_t begin_ns = bench_now_ns();
+                mutex.lock();
+                our_waits.push_back(bench_now_ns() - begin_ns);
+                bench_busy_work(50);
+                mutex.unlock();
+                bench_busy_work(50);
+            }
+        }
+        else
+        {
+            for (uint64_t i = 0; i < WAIT_READER_ITERATIONS; ++i)
+            {
+                mutex.lock_shared();
+                bench_busy_work(50);
+                mutex.unlock_shared();
+            }
+        }
+    });
+
+    std::vector<int64_t> all_waits;
+    for (const std::vector<int64_t> &our_waits : waits)
+    {
+        all_waits.insert(all_waits.end(), our_waits.begin(), our_waits.end());
+    }
+    const std::string bench = name + " " + std::to_string(writers) + "w/" + std::to_string(readers) + "r";
+    bench_report(bench, "p50 writer wait", double(bench_percentile(all_waits, 0.50)), "ns");
+    bench_report(bench, "p99 writer wait", double(bench_percentile(all_waits, 0.99)), "ns");
+    bench_report(bench, "max writer wait", double(all_waits.empty() ? 0 : all_waits.back()), "ns");
+}
+
+#endif // BENCH_WRITER_WAIT_H
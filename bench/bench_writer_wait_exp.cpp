@@ -0,0 +1,17 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench_writer_wait.h"
+#include "exp_recursive_shared_mutex.h"
+
+// exp_recursive_shared_mutex lets every woken writer race for ownership, run the same workloads
+// on it for comparison
+
+BENCH_CASE(writer_wait_writers_only_exp)
+{
+    bench_writer_wait<exp_recursive_shared_mutex>("writer wait exp_rsm", 4, 0);
+}
+
+BENCH_CASE(writer_wait_mixed_exp) { bench_writer_wait<exp_recursive_shared_mutex>("writer wait exp_rsm", 4, 4); }
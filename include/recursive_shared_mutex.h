@@ -6,17 +6,35 @@
 #ifndef _RECURSIVE_SHARED_MUTEX_H
 #define _RECURSIVE_SHARED_MUTEX_H
 
+#include <atomic>
 #include <cassert>
 #include <chrono>
 #include <condition_variable>
 #include <exception>
-#include <map>
 #include <mutex>
+#include <shared_mutex>
 #include <system_error>
 #include <thread>
 #include <tuple>
 #include <type_traits>
 
+#include "rsm_numa.h"
+#include "rsm_padded.h"
+#include "rsm_policies.h"
+#include "rsm_spin.h"
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#ifdef RSM_USE_FUTEX
+#include "rsm_futex.h"
+typedef rsm_futex_mutex rsm_internal_mutex;
+typedef rsm_futex_condition rsm_internal_condition;
+#else
+typedef std::mutex rsm_internal_mutex;
+typedef std::condition_variable rsm_internal_condition;
+#endif
 
 /**
  * This mutex has two levels of access, shared and exclusive. Multiple threads can own this mutex in shared mode but
@@ -32,66 +50,501 @@
 
 static const std::thread::id NON_THREAD_ID = std::thread::id();
 
-class recursive_shared_mutex
-{
-protected:
-    // Only locked when accessing counters, ids, or waiting on condition variables.
-    std::mutex _mutex;
+// how many times optimistic_read() tries to read without locking before it falls back to lock_shared()
+#ifndef RSM_OPTIMISTIC_READ_ATTEMPTS
+#define RSM_OPTIMISTIC_READ_ATTEMPTS 4
+#endif
 
-    // the read_gate is locked (blocked) when threads have write ownership
-    std::condition_variable _read_gate;
+// The members only some policies need live in these bases so that a mutex without the feature has no
+// storage for it at all.
 
-    // the write_gate is locked (blocked) when threads have read ownership or someone is waiting for promotion
-    std::condition_variable _write_gate;
+template <bool OwnerTracking>
+struct rsm_owner_state
+{
+    // _write_owner_id is the id of the thread with exclusive ownership, only ever set to a threads own id by
+    // that thread or by the thread handing ownership to it, so a thread can check if it is the owner
+    // without taking _mutex
+    std::atomic<std::thread::id> _write_owner_id;
 
-    // // the write_gate is locked (blocked) when threads have read ownership
-    std::condition_variable _promotion_write_gate;
+    rsm_owner_state() : _write_owner_id(NON_THREAD_ID) {}
+};
 
-    // holds a list of owner ids that have shared ownership and the number of times they locked it
-    std::map<std::thread::id, uint64_t> _read_owner_ids;
+template <>
+struct rsm_owner_state<false>
+{
+};
 
+template <bool Recursion>
+struct rsm_recursion_state
+{
+    // _write_counter tracks how many times exclusive ownership has been recursively locked
+    uint64_t _write_counter;
     // holds the number of shared locks the thread with exclusive ownership has
     // this is used to allow the thread with exclusive ownership to lock_shared
     uint64_t _shared_while_exclusive_counter;
 
-    // _write_counter tracks how many times exclusive ownership has been recursively locked
-    uint64_t _write_counter;
-    // _write_owner_id is the id of the thread with exclusive ownership
-    std::thread::id _write_owner_id;
-    // _promotion_candidate_id is the id of the thread waiting for a promotion
-    std::thread::id _promotion_candidate_id;
+    rsm_recursion_state() : _write_counter(0), _shared_while_exclusive_counter(0) {}
+};
+
+template <>
+struct rsm_recursion_state<false>
+{
+};
+
+template <bool Promotion>
+struct rsm_promotion_state
+{
+    // A thread waiting in try_promotion() that lives on the waiting threads stack. Candidates are promoted
+    // in the order they arrived, exclusive ownership is handed directly to the candidate at the head of the
+    // queue and its gate is only notified once it is the owner.
+    struct promotion_candidate
+    {
+        std::thread::id thread_id;
+        // 1 if the candidate has shared ownership
+        uint64_t readers;
+        // the numa node the thread runs on, always 0 without the cohort policy
+        size_t node;
+        bool granted;
+        promotion_candidate *next;
+        rsm_internal_condition gate;
+
+        promotion_candidate(const std::thread::id &id, uint64_t shared_owner, const size_t &numa_node)
+            : thread_id(id), readers(shared_owner), node(numa_node), granted(false), next(nullptr)
+        {
+        }
+    };
+
+    // FIFO queue of threads waiting for promotion, only accessed with _mutex locked
+    promotion_candidate *_promotion_queue_head;
+    promotion_candidate *_promotion_queue_tail;
+    // number of queued candidates with shared ownership. The candidates never leave while they wait, so the
+    // head is promoted once this many shared owners are left. Only changed with _mutex locked, releasing
+    // shared owners read it to find out if they have to wake the head
+    std::atomic<uint64_t> _promotion_candidate_readers;
+    // _promoted_id is the id of the thread that got exclusive ownership through promotion
+    std::thread::id _promoted_id;
+
+    // the thread with update ownership, only ever set to a threads own id by that thread
+    std::atomic<std::thread::id> _update_owner_id;
+    // how many times the update owner has recursively locked for update ownership
+    uint64_t _update_counter;
+    // threads waiting in lock_update() park on the update_gate, only accessed with _mutex locked
+    rsm_internal_condition _update_gate;
+    uint64_t _update_waiters;
+
+    // the exclusive owner state that follows is written by a different thread
+    char _promotion_padding[RSM_CACHE_LINE_SIZE];
+
+    rsm_promotion_state()
+        : _promotion_queue_head(nullptr), _promotion_queue_tail(nullptr), _promotion_candidate_readers(0),
+          _promoted_id(NON_THREAD_ID), _update_owner_id(NON_THREAD_ID), _update_counter(0), _update_waiters(0)
+    {
+    }
+};
+
+template <>
+struct rsm_promotion_state<false>
+{
+};
+
+template <size_t Shards>
+struct rsm_shard_state
+{
+    // a slot starts on and fills a whole cache line so readers on different cpus never write to the same
+    // one, and nothing else in the mutex shares a line with them. the count of a slot only goes up and down
+    // by the thread that took the shared ownership, it records which slot it used in rsm_reader_shard_slots
+    struct alignas(RSM_CACHE_LINE_SIZE) reader_shard
+    {
+        std::atomic<uint64_t> readers;
+    };
+
+    reader_shard _reader_shards[Shards];
+
+    rsm_shard_state()
+    {
+        for (size_t i = 0; i < Shards; ++i)
+        {
+            _reader_shards[i].readers = 0;
+        }
+    }
+
+    // the slot of the cpu the calling thread runs on, threads that can not find out use a hash of their id
+    static size_t reader_shard_index()
+    {
+#ifdef __linux__
+        const int cpu = sched_getcpu();
+        if (cpu >= 0)
+        {
+            return static_cast<size_t>(cpu) % Shards;
+        }
+#endif
+        return std::hash<std::thread::id>()(std::this_thread::get_id()) % Shards;
+    }
+
+    // sequentially consistent with the writers, which set their bit in the state word before they count
+    // the shards. either the writer counts a reader or the reader sees the bit
+    void enter_reader_shard(const size_t &index) { _reader_shards[index].readers.fetch_add(1); }
+    void exit_reader_shard(const size_t &index) { _reader_shards[index].readers.fetch_sub(1); }
+    uint64_t sharded_readers()
+    {
+        // the writers set their bit with an acquire compare exchange, without this fence a weakly ordered
+        // cpu could count the shards before the bit is visible to a reader that has just entered one
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint64_t readers = 0;
+        for (size_t i = 0; i < Shards; ++i)
+        {
+            readers += _reader_shards[i].readers.load();
+        }
+        return readers;
+    }
+};
+
+// without shards every shared owner is counted in the state word, the sharded paths of the mutex are
+// compiled but never taken
+template <>
+struct rsm_shard_state<0>
+{
+    static size_t reader_shard_index() { return 0; }
+    void enter_reader_shard(const size_t &) {}
+    void exit_reader_shard(const size_t &) {}
+    uint64_t sharded_readers() { return 0; }
+};
+
+// all of the members are only accessed with _mutex locked
+template <size_t LocalHandoffs>
+struct rsm_cohort_state
+{
+    // the node of the last thread that was given exclusive ownership and how many times in a row
+    // ownership or a batch of readers went to that node since
+    size_t _cohort_node;
+    uint64_t _local_handoffs;
+    // the readers parked on the read_gate from each node and the number of batches admitted from each
+    uint64_t _node_readers_parked[RSM_NUMA_MAX_NODES];
+    uint64_t _node_reader_batch[RSM_NUMA_MAX_NODES];
+    // keeps the lines written with _mutex locked apart from the owner state after them
+    char _cohort_padding[RSM_CACHE_LINE_SIZE];
+
+    // no node to begin with, so the first owner does not count as a local hand-off
+    rsm_cohort_state()
+        : _cohort_node(RSM_NUMA_MAX_NODES), _local_handoffs(0), _node_readers_parked(), _node_reader_batch()
+    {
+    }
+
+    static size_t cohort_node() { return rsm_numa_current_node(); }
+
+    void cohort_exclusive_taken(const size_t &node)
+    {
+        if (node == _cohort_node)
+        {
+            _local_handoffs++;
+            return;
+        }
+        _cohort_node = node;
+        _local_handoffs = 0;
+    }
+
+    // the first waiter on the cohort node while it may keep ownership, otherwise the first waiter on
+    // another node. the head of the queue if there is none
+    template <class Waiter>
+    Waiter *next_exclusive_waiter(Waiter *head)
+    {
+        const bool stay_local = (_local_handoffs < LocalHandoffs);
+        for (Waiter *waiter = head; waiter != nullptr; waiter = waiter->next)
+        {
+            if ((waiter->node == _cohort_node) == stay_local)
+            {
+                return waiter;
+            }
+        }
+        return head;
+    }
+
+    void cohort_park_reader(const size_t &node) { _node_readers_parked[node]++; }
+    void cohort_unpark_reader(const size_t &node) { _node_readers_parked[node]--; }
+    uint64_t cohort_reader_batch(const size_t &node) { return _node_reader_batch[node]; }
+    bool cohort_reader_admitted(const size_t &node, const uint64_t &batch) { return _node_reader_batch[node] != batch; }
+
+    // @param writer_waiting a writer goes after this batch, without one every parked reader is admitted
+    // @return the number of readers admitted
+    uint64_t cohort_admit_readers(const bool &writer_waiting, const uint64_t &readers_parked)
+    {
+        // there is no cohort node until someone took exclusive ownership
+        if (writer_waiting && _cohort_node < RSM_NUMA_MAX_NODES && _local_handoffs < LocalHandoffs &&
+            _node_readers_parked[_cohort_node] != 0)
+        {
+            // the readers on other nodes wait for the next batch
+            const uint64_t admitted = _node_readers_parked[_cohort_node];
+            _node_readers_parked[_cohort_node] = 0;
+            _node_reader_batch[_cohort_node]++;
+            _local_handoffs++;
+            return admitted;
+        }
+        for (size_t node = 0; node < RSM_NUMA_MAX_NODES; ++node)
+        {
+            if (_node_readers_parked[node] != 0)
+            {
+                _node_readers_parked[node] = 0;
+                _node_reader_batch[node]++;
+            }
+        }
+        return readers_parked;
+    }
+};
+
+// without the cohort policy every node is node 0 and the waiting threads go in the order they came
+template <>
+struct rsm_cohort_state<0>
+{
+    static size_t cohort_node() { return 0; }
+    void cohort_exclusive_taken(const size_t &) {}
+    template <class Waiter>
+    Waiter *next_exclusive_waiter(Waiter *head)
+    {
+        return head;
+    }
+    void cohort_park_reader(const size_t &) {}
+    void cohort_unpark_reader(const size_t &) {}
+    uint64_t cohort_reader_batch(const size_t &) { return 0; }
+    bool cohort_reader_admitted(const size_t &, const uint64_t &) { return true; }
+    uint64_t cohort_admit_readers(const bool &, const uint64_t &readers_parked) { return readers_parked; }
+};
+
+/**
+ * recursive_shared_mutex with its features chosen at compile time, see rsm_policies.h.
+ * basic_recursive_shared_mutex<> has every feature, recursive_shared_mutex is an alias for it.
+ *
+ * Without recursion a thread must not lock a mutex it already has ownership of, with owner tracking and
+ * debug assertions this throws instead of deadlocking. Without recursion try_promotion() must be called
+ * by a thread with shared ownership.
+ */
+template <class... Policies>
+class basic_recursive_shared_mutex
+    : protected rsm_promotion_state<rsm_policy_selector<Policies...>::promotion>,
+      protected rsm_shard_state<rsm_policy_selector<Policies...>::reader_shards>,
+      protected rsm_cohort_state<rsm_policy_selector<Policies...>::numa_cohort>,
+      protected rsm_owner_state<rsm_policy_selector<Policies...>::owner_tracking>,
+      protected rsm_recursion_state<rsm_policy_selector<Policies...>::recursion>
+{
+public:
+    typedef rsm_policy_selector<Policies...> policies;
+    static_assert(!policies::recursion || policies::owner_tracking, "recursion needs owner_tracking");
+    static_assert(policies::reader_shards == 0 || policies::recursion, "reader_shards needs recursion");
+
+protected:
+    // The members are grouped by who writes them. The bases some policies add come first: the promotion
+    // queue and update state, the reader shards and the cohort state, each ending in a whole cache line of
+    // padding or, for the shards, made of whole aligned cache lines. Then the state of the exclusive owner (with
+    // the owner and recursion state from the bases), then the state word every reader writes to, then _mutex
+    // and everything only touched with it locked. A whole cache line of padding between the groups keeps them
+    // off each other's lines wherever the mutex is placed, so without reader shards the type is not aligned
+    // beyond what operator new guarantees before C++17. Readers coming and going then never take the line the
+    // exclusive owner works on away from it, or the other way round.
+
+    // steady clock time in nanoseconds when the current exclusive ownership started, 0 when there is none
+    // or it is not being timed
+    std::atomic<int64_t> _exclusive_since_ns;
+    // only one in HOLD_SAMPLE_INTERVAL exclusive ownerships is timed, counted by the exclusive owner
+    static constexpr uint64_t HOLD_SAMPLE_INTERVAL = 8;
+    uint64_t _exclusive_acquisitions;
+    // moving average of how long exclusive ownership is held, waiting threads spin for a few times this long
+    // before parking on the gates
+    std::atomic<int64_t> _average_hold_ns;
 
-    // used to keep track of normal thread exclusive line if a thread has promoted
-    uint64_t _write_counter_reserve;
+    char _owner_padding[RSM_CACHE_LINE_SIZE];
+
+    // Packed ownership state. The low bits count threads with shared ownership, the high bits flag writer and
+    // promotion activity. Shared ownership is taken and released with a single atomic operation on this word as long as
+    // none of the blocking bits are set, only then do threads fall back to _mutex and the condition variables.
+    std::atomic<uint64_t> _state;
+
+    // incremented every time exclusive ownership ends, only written with _mutex locked by the thread
+    // giving up exclusive ownership before it clears WRITER_HELD
+    std::atomic<uint64_t> _write_generation;
+
+    char _state_padding[RSM_CACHE_LINE_SIZE];
+
+    // number of threads with shared ownership, not counting the thread with exclusive ownership or the ones
+    // counted in reader shards
+    static constexpr uint64_t READER_MASK = (uint64_t(1) << 48) - 1;
+    // a thread has exclusive ownership
+    static constexpr uint64_t WRITER_HELD = uint64_t(1) << 63;
+    // the thread at the head of the exclusive queue is next in line and waiting for the shared owners to leave
+    static constexpr uint64_t WRITER_WAITING = uint64_t(1) << 62;
+    // threads are queued for promotion or a thread that got exclusive ownership through promotion still has it
+    static constexpr uint64_t PROMOTION_PENDING = uint64_t(1) << 61;
+    // a thread has update ownership, it is also counted as a shared owner
+    static constexpr uint64_t UPDATE_HELD = uint64_t(1) << 60;
+    // new shared ownership (not recursive) is only granted while none of these are set, a reader_preferring
+    // mutex lets new readers in while a writer is waiting
+    static constexpr uint64_t READER_BLOCKED = (policies::fairness == rsm_fairness::reader_preferring) ?
+                                                   (WRITER_HELD | PROMOTION_PENDING) :
+                                                   (WRITER_HELD | WRITER_WAITING | PROMOTION_PENDING);
+
+    // Only locked when changing writer or promotion state, or waiting on condition variables.
+    // With --enable-futex these are futex based and wait directly on words inside this object.
+    rsm_internal_mutex _mutex;
+
+    // threads waiting for shared ownership park on the read_gate until a thread clearing the blocking
+    // bits admits all of them at once
+    rsm_internal_condition _read_gate;
+
+    // number of threads parked on the read_gate and the number of batches of readers admitted so far,
+    // only accessed with _mutex locked
+    uint64_t _readers_parked;
+    uint64_t _reader_batch;
+
+    // A thread waiting in lock() that lives on the waiting threads stack. Exclusive ownership is handed
+    // directly to the waiter at the head of the queue, or the first one on the cohort node with the cohort
+    // policy. Its gate is only notified once it is the owner.
+    struct exclusive_waiter
+    {
+        std::thread::id thread_id;
+        // the numa node the thread runs on, always 0 without the cohort policy
+        size_t node;
+        bool granted;
+        exclusive_waiter *next;
+        rsm_internal_condition gate;
+
+        exclusive_waiter(const std::thread::id &id, const size_t &numa_node)
+            : thread_id(id), node(numa_node), granted(false), next(nullptr)
+        {
+        }
+    };
+
+    typedef rsm_promotion_state<true>::promotion_candidate promotion_candidate;
+
+    // FIFO queue of threads waiting in lock(), only accessed with _mutex locked
+    exclusive_waiter *_exclusive_queue_head;
+    exclusive_waiter *_exclusive_queue_tail;
 
 private:
+    // the features turned off by the policies are handled by the std::false_type overloads, which
+    // never touch the members the feature would need
+    typedef std::integral_constant<bool, policies::recursion> recursion_enabled;
+    typedef std::integral_constant<bool, policies::promotion> promotion_enabled;
+    typedef std::integral_constant<bool, policies::owner_tracking> owner_tracking_enabled;
+    typedef std::integral_constant<bool, (policies::reader_shards != 0)> sharding_enabled;
+
     bool end_of_exclusive_ownership();
     bool check_for_write_lock(const std::thread::id &locking_thread_id);
+    bool check_for_write_lock(const std::thread::id &locking_thread_id, std::true_type);
+    bool check_for_write_lock(const std::thread::id &locking_thread_id, std::false_type);
     bool check_for_write_unlock(const std::thread::id &locking_thread_id);
+    bool lock_recursive(const std::thread::id &locking_thread_id, std::true_type);
+    bool lock_recursive(const std::thread::id &locking_thread_id, std::false_type);
+    bool lock_shared_while_exclusive(const std::thread::id &locking_thread_id, std::true_type);
+    bool lock_shared_while_exclusive(const std::thread::id &locking_thread_id, std::false_type);
+    void set_write_owner(const std::thread::id &owner_id, std::true_type);
+    void set_write_owner(const std::thread::id &owner_id, std::false_type);
+    void take_exclusive_ownership(const std::thread::id &locking_thread_id);
+    void lock_recursive_count(std::true_type);
+    void lock_recursive_count(std::false_type);
+    bool holds_promotion(std::true_type);
+    bool holds_promotion(std::false_type);
+    uint64_t end_promotion(std::true_type);
+    uint64_t end_promotion(std::false_type);
+    void end_exclusive_timing();
+    void end_write_generation();
+    void publish_exclusive_ownership();
+    void release_exclusive_ownership();
+    uint64_t downgrade_exclusive_locks(std::true_type);
+    uint64_t downgrade_exclusive_locks(std::false_type);
+    void admit_parked_readers();
+    bool readers_go_next(const uint64_t &state);
+    void hand_off_promotion(const uint64_t &state, std::true_type);
+    void hand_off_promotion(const uint64_t &state, std::false_type);
+    uint64_t queued_candidate_readers(std::true_type);
+    uint64_t queued_candidate_readers(std::false_type);
+    void remove_promotion_candidate(promotion_candidate *candidate);
+    void wake_update_waiter(std::true_type);
+    void wake_update_waiter(std::false_type);
+    bool lock_update_recursive(const std::thread::id &locking_thread_id);
+    bool try_lock_update_fast(const std::thread::id &locking_thread_id);
+    bool has_lock_shared(std::true_type);
+    bool has_lock_shared(std::false_type);
+    void add_update_shared_lock(std::true_type);
+    void add_update_shared_lock(std::false_type);
+    uint64_t drop_update_shared_lock(std::true_type);
+    uint64_t drop_update_shared_lock(std::false_type);
+    bool hand_off_exclusive_ownership();
+    template <class Waiter>
+    static void push_waiter(Waiter *&head, Waiter *&tail, Waiter *waiter);
+    template <class Waiter>
+    static void remove_waiter(Waiter *&head, Waiter *&tail, Waiter *waiter);
+    void wake_next_owner();
+    int64_t spin_budget_ns();
+    template <class Predicate>
+    bool spin_until(Predicate ready);
+
+    uint64_t &shared_count_for_this_thread();
+    bool already_has_lock_shared();
+    uint64_t promotion_candidate_readers(std::true_type);
+    uint64_t promotion_candidate_readers(std::false_type);
+    bool try_lock_shared_recursive(std::true_type);
+    bool try_lock_shared_recursive(std::false_type);
+    void record_shared_lock(std::true_type);
+    void record_shared_lock(std::false_type);
+    void lock_shared_internal(const uint64_t &count = 1);
+    void unlock_shared_internal(const uint64_t &count = 1);
+    void release_shared_ownership();
+    bool try_lock_shared_fast();
+    bool try_lock_shared_fast(std::true_type);
+    bool try_lock_shared_fast(std::false_type);
+    bool try_lock_shared_central();
+    uint64_t shared_owners(const uint64_t &state);
+    void leave_reader_shard(const size_t &index);
+    bool release_sharded_ownership(std::true_type);
+    bool release_sharded_ownership(std::false_type);
+    void unlock(std::true_type);
+    void unlock(std::false_type);
+    void unlock_shared(std::true_type);
+    void unlock_shared(std::false_type);
+
+    // the blocking calls and their timed variants, a null deadline waits forever
+    bool lock_until_steady(const std::chrono::steady_clock::time_point *deadline);
+    bool try_promotion_until_steady(const std::chrono::steady_clock::time_point *deadline);
+    bool lock_shared_until_steady(const std::chrono::steady_clock::time_point *deadline);
+    template <class Predicate>
+    bool wait_on_gate(rsm_internal_condition &gate,
+        std::unique_lock<rsm_internal_mutex> &lock,
+        const std::chrono::steady_clock::time_point *deadline,
+        Predicate ready);
 
-    bool already_has_lock_shared(const std::thread::id &locking_thread_id);
-    void lock_shared_internal(const std::thread::id &locking_thread_id, const uint64_t &count = 1);
-    void unlock_shared_internal(const std::thread::id &locking_thread_id, const uint64_t &count = 1);
+    template <class Clock, class Duration>
+    static std::chrono::steady_clock::time_point to_steady_deadline(
+        const std::chrono::time_point<Clock, Duration> &deadline)
+    {
+        return std::chrono::steady_clock::now() +
+               std::chrono::duration_cast<std::chrono::steady_clock::duration>(deadline - Clock::now());
+    }
 
 public:
-    recursive_shared_mutex()
+    basic_recursive_shared_mutex()
     {
-        _read_owner_ids.clear();
-        _write_counter = 0;
-        _shared_while_exclusive_counter = 0;
-        _write_owner_id = NON_THREAD_ID;
-        _promotion_candidate_id = NON_THREAD_ID;
-        _write_counter_reserve = 0;
+        _state = 0;
+        _write_generation = 0;
+        _readers_parked = 0;
+        _reader_batch = 0;
+        _exclusive_queue_head = nullptr;
+        _exclusive_queue_tail = nullptr;
+        _exclusive_since_ns = 0;
+        _exclusive_acquisitions = 0;
+        _average_hold_ns = 0;
     }
 
-    ~recursive_shared_mutex() {}
-    recursive_shared_mutex(const recursive_shared_mutex &) = delete;
-    recursive_shared_mutex &operator=(const recursive_shared_mutex &) = delete;
+    ~basic_recursive_shared_mutex() {}
+    basic_recursive_shared_mutex(const basic_recursive_shared_mutex &) = delete;
+    basic_recursive_shared_mutex &operator=(const basic_recursive_shared_mutex &) = delete;
 
     /**
      * "Wait in line" for exclusive ownership of the mutex.
      *
      * This call is blocking when waiting for exclusive ownership.
+     * Waiting threads are queued in FIFO order, when the mutex is released exclusive
+     * ownership is handed directly to the thread at the head of the queue.
+     * A waiting thread first spins for a budget based on how long exclusive ownership of this
+     * mutex is usually held, it parks right away if the owner has already held on for longer or
+     * if every core already has a spinning thread.
      * When exclusive ownership is obtained the id of the thread that made this call
      * is stored in _write_ownder_id and _write_counter is incremeneted by 1.
      * When called by a thread that already has exclusive ownership,t
@@ -104,25 +557,145 @@ public:
     void lock();
 
     /**
-     * Become "next in line" for exclusive ownership of the mutex if the promotion
-     * slot is not already occupied by another thread.
+     * Wait in line for exclusive ownership like lock() but give up after timeout_duration
+     * or once abs_time has been reached.
+     *
+     * When a thread that gives up was the only one waiting in lock(), threads waiting for
+     * shared ownership that it was blocking are admitted.
+     *
+     * @param timeout_duration or abs_time, how long to wait
+     * @return: false if the time ran out before exclusive ownership was obtained
+     * true when _write_counter has been incremented or exclusive ownership has been
+     * obtained
+     */
+    template <class Rep, class Period>
+    bool try_lock_for(const std::chrono::duration<Rep, Period> &timeout_duration)
+    {
+        return try_lock_until(std::chrono::steady_clock::now() + timeout_duration);
+    }
+
+    template <class Clock, class Duration>
+    bool try_lock_until(const std::chrono::time_point<Clock, Duration> &abs_time)
+    {
+        const std::chrono::steady_clock::time_point deadline = to_steady_deadline(abs_time);
+        return lock_until_steady(&deadline);
+    }
+
+    /**
+     * Get in line for exclusive ownership of the mutex ahead of the threads waiting in lock().
      *
-     * When called by a thread that has shared ownership or no ownership, attempt to
-     * obtain the promotion slot. Only one thread can hold the promotion slot at a time.
-     * While promotion slot is obtained and waiting for exclusive ownership this
-     * call is blocking.
+     * When called by a thread that has shared ownership or no ownership, the thread is queued
+     * behind any other threads already waiting for promotion. Candidates are promoted one after
+     * another in the order they called, each of them ahead of every thread waiting in lock(), and
+     * new shared owners are blocked until the queue is empty. A candidate only waits for the
+     * shared owners that are not candidates themselves to leave, so any number of readers can ask
+     * for promotion at the same time without deadlocking. A candidate that was queued behind
+     * another one must expect the data to have changed while it waited.
+     * This call is blocking while waiting for exclusive ownership.
      * When called by a thread that already has exclusive ownership,
      * _write_counter is incremeneted by 1 and call does not block
      *
      *
      * @param none
-     * @return: false on failure to be put in the promotion slot because
-     * it is already occupied by another thread.
+     * @return: false if another thread has update ownership, that thread is always promoted next.
      * true when _write_counter has been incremented or exclusive ownership has been
      * obtained
      */
     bool try_promotion();
 
+    /**
+     * Like try_promotion() but give up waiting for exclusive ownership after timeout_duration
+     * or once abs_time has been reached.
+     *
+     * A thread that gives up leaves the promotion queue, if it was the last candidate the threads
+     * waiting for shared ownership that it was blocking are admitted. It keeps the shared ownership
+     * it already had.
+     *
+     * @param timeout_duration or abs_time, how long to wait
+     * @return: false if another thread has update ownership or if the time ran out.
+     * true when _write_counter has been incremented or exclusive ownership has been
+     * obtained
+     */
+    template <class Rep, class Period>
+    bool try_promotion_for(const std::chrono::duration<Rep, Period> &timeout_duration)
+    {
+        return try_promotion_until(std::chrono::steady_clock::now() + timeout_duration);
+    }
+
+    template <class Clock, class Duration>
+    bool try_promotion_until(const std::chrono::time_point<Clock, Duration> &abs_time)
+    {
+        const std::chrono::steady_clock::time_point deadline = to_steady_deadline(abs_time);
+        return try_promotion_until_steady(&deadline);
+    }
+
+    /**
+     * Promote to exclusive ownership only if that is possible right away, without waiting for _mutex or
+     * for other shared owners and without getting in line. Unlike try_promotion_until() with a deadline
+     * that has already passed, new readers are never turned away and no waiting writer is overtaken by a
+     * promotion that then gives up.
+     *
+     * @return: false if another thread has any ownership besides a waiting writer, or if a thread is
+     * queued for promotion or busy changing the state of the mutex. true when _write_counter has been
+     * incremented or exclusive ownership has been obtained
+     */
+    bool try_promotion_no_wait();
+
+    /**
+     * Claim update ownership. Update ownership is shared ownership that only one thread can have at
+     * a time, the thread with update ownership is guaranteed to get the next promotion so it can read,
+     * decide and then upgrade() without ever having to give up and re-read.
+     *
+     * This call is blocking while another thread has update or exclusive ownership or is waiting for
+     * promotion, and like lock_shared() while a thread waits in lock() unless the mutex is reader_preferring.
+     * When called by the thread with update ownership the update lock count is incremented by 1.
+     * When called by the thread with exclusive ownership it counts as a call to lock_shared().
+     * A thread that only has shared ownership must use try_lock_update() instead, waiting for the other
+     * update owner or promotion candidate while holding shared ownership would deadlock.
+     * Needs the promotion policy.
+     *
+     *
+     * @param none
+     * @return none
+     */
+    void lock_update();
+
+    /**
+     * Claim update ownership like lock_update() but never block.
+     *
+     *
+     * @param none
+     * @return: false on failure to obtain update ownership.
+     * true when the update lock count has been incremented or update ownership has been obtained
+     */
+    bool try_lock_update();
+
+    /**
+     * Release 1 count of update ownership.
+     *
+     * This call never blocks.
+     * When the update lock count reaches 0 the thread gives up update ownership and the shared lock
+     * that came with it, other shared locks it holds are kept.
+     *
+     *
+     * @param none
+     * @return none
+     */
+    void unlock_update();
+
+    /**
+     * Turn update ownership into exclusive ownership, blocks until all other shared owners have left.
+     *
+     * Must be called by the thread with update ownership. No other thread can be queued for promotion
+     * while a thread has update ownership so this always succeeds. Exclusive ownership is released with
+     * unlock() and the thread keeps update ownership, or turned back into shared locks with downgrade().
+     *
+     *
+     * @param none
+     * @return none
+     */
+    void upgrade();
+
     /**
      * Attempt to claim exclusive ownership of the mutex if no threads
      * have exclusive or shared ownership of the mutex including this one.
@@ -153,16 +726,126 @@ public:
      */
     void unlock();
 
+    /**
+     * Turn exclusive ownership into shared ownership without letting another thread take
+     * exclusive ownership in between.
+     *
+     * This call never blocks.
+     * Must be called by the thread with exclusive ownership. Every exclusive lock and every
+     * shared lock it holds becomes a shared lock, so the thread has to call unlock_shared() once
+     * for each of them. Threads waiting for shared ownership are admitted in the same step
+     * whatever the fairness policy, unless another thread is waiting for promotion.
+     * Threads waiting in lock() keep waiting until all shared ownership has been released.
+     *
+     *
+     * @param none
+     * @return none
+     */
+    void downgrade();
+
+    /**
+     * The number of times exclusive ownership of this mutex has ended so far. Remember it while
+     * holding shared ownership and pass it to written_since() after getting ownership again to find
+     * out if a writer could have changed the data in between.
+     *
+     * This call never blocks.
+     * The generation only changes when exclusive ownership is released by unlock() or downgrade(),
+     * recursive unlocks and shared locks held by the exclusive owner do not count. It can be read
+     * with or without ownership, only a value read with ownership describes the protected data.
+     *
+     *
+     * @param none
+     * @return the current write generation
+     */
+    uint64_t write_generation() const;
+
+    /**
+     * Check if any thread could have changed the data since generation was read.
+     *
+     * This call never blocks.
+     * Meant to be called after getting ownership again, e.g. with lock() after try_promotion()
+     * failed. When it returns false no thread had exclusive ownership in between so anything
+     * checked while holding ownership before still holds. Exclusive ownership the calling thread
+     * has right now is not counted until it is released.
+     *
+     *
+     * @param generation a value returned by write_generation() while holding ownership
+     * @return true if exclusive ownership was released since generation was read
+     */
+    bool written_since(const uint64_t &generation) const;
+
+    /**
+     * Start an optimistic read of the data this mutex protects, without taking any ownership.
+     *
+     * This call never blocks and writes nothing, so readers on different cores do not take the
+     * cache line of the mutex away from each other. The thread reads the data and then calls
+     * read_validate() with the returned version, the values it read are only usable if that returns
+     * true. A writer can change the data while it is being read, so the data must be read with
+     * std::atomic loads (relaxed is enough) or copied and only looked at after validation, and no
+     * pointer read this way may be followed before validation.
+     * Works against every way of getting exclusive ownership, lock(), try_lock(), try_promotion()
+     * and upgrade().
+     *
+     *
+     * @param none
+     * @return the version to pass to read_validate()
+     */
+    uint64_t read_begin() const;
+
+    /**
+     * Check that no thread had exclusive ownership while an optimistic read was in progress.
+     *
+     * This call never blocks and writes nothing.
+     *
+     *
+     * @param version the value returned by read_begin() when the read started
+     * @return true if the data read since read_begin() is consistent, false if it has to be read again
+     */
+    bool read_validate(const uint64_t &version) const;
+
+    /**
+     * Call read optimistically until a read validates, after attempts failed reads call it
+     * once more with shared ownership so a steady stream of writers can not starve the reader.
+     *
+     * read follows the same rules as any other optimistic read, see read_begin(). It can be
+     * called several times and must not have side effects other than returning what it read.
+     *
+     *
+     * @param read callable without arguments that returns the values it read
+     * @param attempts how many optimistic reads to try before locking
+     * @return the result of the first read that was consistent
+     */
+    template <class Function>
+    auto optimistic_read(Function read, uint32_t attempts = RSM_OPTIMISTIC_READ_ATTEMPTS) -> decltype(read())
+    {
+        rsm_backoff backoff;
+        for (uint32_t i = 0; i < attempts; ++i)
+        {
+            const uint64_t version = read_begin();
+            auto result = read();
+            if (read_validate(version))
+            {
+                return result;
+            }
+            backoff.pause();
+        }
+        std::shared_lock<basic_recursive_shared_mutex> _lock(*this);
+        return read();
+    }
+
     /**
      * Attempt to claim shared ownership
      *
      * This call is blocking when waiting for shared ownership due to a thread having
-     * exclusive ownership.
-     * When shared ownership is obtained the id of the thread that made this call
-     * is stored in _read_owner_ids with a value of 1. Recursively locking for shared
-     * ownership increments the threads value in _read_owner_ids by 1.
+     * exclusive ownership, waiting for exclusive ownership (unless the mutex is reader_preferring),
+     * or waiting for promotion.
+     * When no thread is doing any of those shared ownership is obtained with a single
+     * atomic update of _state without locking _mutex. Otherwise the thread spins like lock()
+     * before parking.
+     * The number of shared locks held by the calling thread is tracked in thread local storage,
+     * recursively locking for shared ownership never blocks and does not touch _state.
      * If this is called by a thread with exclusive ownership, increment the _shared_while_exclusive_counter
-     * by 1 instead of making an entry in _read_owner_ids
+     * by 1 instead
      *
      *
      * @param none
@@ -170,19 +853,41 @@ public:
      */
     void lock_shared();
 
+    /**
+     * Claim shared ownership like lock_shared() but give up after timeout_duration
+     * or once abs_time has been reached.
+     *
+     * @param timeout_duration or abs_time, how long to wait
+     * @return: false if the time ran out before shared ownership was obtained.
+     * true when the threads shared lock count has been incremented or shared ownership has been
+     * obtained
+     */
+    template <class Rep, class Period>
+    bool try_lock_shared_for(const std::chrono::duration<Rep, Period> &timeout_duration)
+    {
+        return try_lock_shared_until(std::chrono::steady_clock::now() + timeout_duration);
+    }
+
+    template <class Clock, class Duration>
+    bool try_lock_shared_until(const std::chrono::time_point<Clock, Duration> &abs_time)
+    {
+        const std::chrono::steady_clock::time_point deadline = to_steady_deadline(abs_time);
+        return lock_shared_until_steady(&deadline);
+    }
+
     /**
      * Attempt to claim shared ownership of the mutex if no threads
      * have exclusive ownership of the mutex.
      *
      * This call never blocks.
      * When called by a thread that already has shared ownership, the threads
-     * _read_owner_ids value is incremeneted by 1
+     * shared lock count is incremeneted by 1
      * When called by a thread that has exclusive ownership, _shared_while_exclusive_counter is incremeneted by 1
      *
      *
      * @param none
      * @return: false on failure to obtain shared ownership.
-     * true when the threads _read_owner_ids has been incremented or shared ownership has been
+     * true when the threads shared lock count has been incremented or shared ownership has been
      * obtained
      */
     bool try_lock_shared();
@@ -191,9 +896,10 @@ public:
      * Release 1 count of ownership
      *
      * This call never blocks.
-     * When called by a thread that has shared ownership, decrement the value of that thread in
-     * _read_owner_ids by 1. When that threads value reaches 0, remove it from _read_owner_ids signifying the
-     * end of shared ownership.
+     * When called by a thread that has shared ownership, decrement the shared lock count of that
+     * thread by 1. When that count reaches 0 the thread no longer has shared ownership and _state
+     * is updated.
+     * _mutex is only locked to wake a thread waiting for exclusive ownership or promotion.
      * When called by a thread with exclusive ownership decrement _shared_while_exclusive_counter by 1.
      *
      *
@@ -201,7 +907,123 @@ public:
      * @return none
      */
     void unlock_shared();
+
+    /**
+     * Check if the calling thread has shared ownership of the mutex, from lock_shared(), update
+     * ownership or because it has exclusive ownership.
+     *
+     * This call never blocks.
+     * Without recursion shared locks are not tracked per thread, only exclusive ownership is seen then.
+     *
+     *
+     * @param none
+     * @return true if the calling thread has shared or exclusive ownership
+     */
+    bool has_shared_ownership();
 };
 
+/**
+ * The mutex selected by rsm_null_mutex. It has no members and every call is a no-op that succeeds, so code
+ * written against recursive_shared_mutex can be built for a single thread without any locking cost.
+ */
+template <>
+class basic_recursive_shared_mutex<rsm_null_mutex>
+{
+public:
+    void lock() {}
+    template <class Rep, class Period>
+    bool try_lock_for(const std::chrono::duration<Rep, Period> &)
+    {
+        return true;
+    }
+    template <class Clock, class Duration>
+    bool try_lock_until(const std::chrono::time_point<Clock, Duration> &)
+    {
+        return true;
+    }
+    bool try_promotion() { return true; }
+    template <class Rep, class Period>
+    bool try_promotion_for(const std::chrono::duration<Rep, Period> &)
+    {
+        return true;
+    }
+    template <class Clock, class Duration>
+    bool try_promotion_until(const std::chrono::time_point<Clock, Duration> &)
+    {
+        return true;
+    }
+    bool try_promotion_no_wait() { return true; }
+    bool try_lock() { return true; }
+    void unlock() {}
+    void downgrade() {}
+    // there are no other threads, only the caller writes
+    uint64_t write_generation() const { return 0; }
+    bool written_since(const uint64_t &) const { return false; }
+    uint64_t read_begin() const { return 0; }
+    bool read_validate(const uint64_t &) const { return true; }
+    template <class Function>
+    auto optimistic_read(Function read, uint32_t = RSM_OPTIMISTIC_READ_ATTEMPTS) -> decltype(read())
+    {
+        return read();
+    }
+    void lock_update() {}
+    bool try_lock_update() { return true; }
+    void unlock_update() {}
+    void upgrade() {}
+    void lock_shared() {}
+    template <class Rep, class Period>
+    bool try_lock_shared_for(const std::chrono::duration<Rep, Period> &)
+    {
+        return true;
+    }
+    template <class Clock, class Duration>
+    bool try_lock_shared_until(const std::chrono::time_point<Clock, Duration> &)
+    {
+        return true;
+    }
+    bool try_lock_shared() { return true; }
+    void unlock_shared() {}
+    bool has_shared_ownership() { return false; }
+};
+
+typedef basic_recursive_shared_mutex<> recursive_shared_mutex;
+typedef basic_recursive_shared_mutex<rsm_null_mutex> null_recursive_shared_mutex;
+
+// the fairness policy chosen by the type, recursive_shared_mutex itself is phase fair
+template <rsm_fairness Fairness>
+using rsm_fairness_mutex = basic_recursive_shared_mutex<rsm_fairness_policy<Fairness> >;
+
+typedef rsm_fairness_mutex<rsm_fairness::phase_fair> phase_fair_recursive_shared_mutex;
+typedef rsm_fairness_mutex<rsm_fairness::reader_preferring> reader_preferring_recursive_shared_mutex;
+typedef rsm_fairness_mutex<rsm_fairness::writer_preferring> writer_preferring_recursive_shared_mutex;
+
+// the number of reader shards of sharded_recursive_shared_mutex, more than the cores the machine has only
+// makes writers slower
+#ifndef RSM_READER_SHARDS
+#define RSM_READER_SHARDS 64
+#endif
+
+// shared owners counted in one slot per cpu, see rsm_reader_shards
+template <size_t Shards>
+using rsm_sharded_mutex = basic_recursive_shared_mutex<rsm_reader_shards<Shards> >;
+
+typedef rsm_sharded_mutex<RSM_READER_SHARDS> sharded_recursive_shared_mutex;
+
+// the number of hand-offs in a row numa_recursive_shared_mutex keeps on one numa node
+#ifndef RSM_NUMA_LOCAL_HANDOFFS
+#define RSM_NUMA_LOCAL_HANDOFFS 64
+#endif
+
+// ownership handed to waiting threads on the same numa node first, see rsm_numa_cohort
+template <size_t LocalHandoffs>
+using rsm_cohort_mutex = basic_recursive_shared_mutex<rsm_numa_cohort<LocalHandoffs> >;
+
+typedef rsm_cohort_mutex<RSM_NUMA_LOCAL_HANDOFFS> numa_recursive_shared_mutex;
+
+#include "recursive_shared_mutex_impl.h"
+#include "rsm_update_lock.h"
+
+// recursive_shared_mutex is compiled into the library, other policy combinations are instantiated where used
+extern template class basic_recursive_shared_mutex<>;
 
 #endif // _RECURSIVE_SHARED_MUTEX_H
@@ -0,0 +1,1312 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// Member definitions of basic_recursive_shared_mutex, only meant to be included by recursive_shared_mutex.h
+
+#ifndef _RECURSIVE_SHARED_MUTEX_IMPL_H
+#define _RECURSIVE_SHARED_MUTEX_IMPL_H
+
+#include "rsm_owner_table.h"
+#include "rsm_spin.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+// the number of shared locks this thread holds on each mutex it has shared ownership of
+extern thread_local rsm_owner_table<RSM_OWNER_TABLE_CAPACITY> rsm_shared_lock_counts;
+// the reader shard index + 1 of each mutex this thread has shared ownership of through a reader shard
+extern thread_local rsm_owner_table<RSM_OWNER_TABLE_CAPACITY> rsm_reader_shard_slots;
+
+template <class... Policies>
+constexpr uint64_t basic_recursive_shared_mutex<Policies...>::READER_MASK;
+template <class... Policies>
+constexpr uint64_t basic_recursive_shared_mutex<Policies...>::WRITER_HELD;
+template <class... Policies>
+constexpr uint64_t basic_recursive_shared_mutex<Policies...>::WRITER_WAITING;
+template <class... Policies>
+constexpr uint64_t basic_recursive_shared_mutex<Policies...>::PROMOTION_PENDING;
+template <class... Policies>
+constexpr uint64_t basic_recursive_shared_mutex<Policies...>::UPDATE_HELD;
+template <class... Policies>
+constexpr uint64_t basic_recursive_shared_mutex<Policies...>::READER_BLOCKED;
+template <class... Policies>
+constexpr uint64_t basic_recursive_shared_mutex<Policies...>::HOLD_SAMPLE_INTERVAL;
+
+////////////////////////
+///
+/// Private Functions
+///
+
+template <class... Policies>
+bool basic_recursive_shared_mutex<Policies...>::end_of_exclusive_ownership()
+{
+    return (this->_shared_while_exclusive_counter == 0 && this->_write_counter == 0);
+}
+
+template <class... Policies>
+bool basic_recursive_shared_mutex<Policies...>::check_for_write_lock(const std::thread::id &locking_thread_id)
+{
+    return check_for_write_lock(locking_thread_id, owner_tracking_enabled());
+}
+
+template <class... Policies>
+bool basic_recursive_shared_mutex<Policies...>::check_for_write_lock(const std::thread::id &locking_thread_id,
+    std::true_type)
+{
+    return (this->_write_owner_id.load(std::memory_order_relaxed) == locking_thread_id);
+}
+
+template <class... Policies>
+bool basic_recursive_shared_mutex<Policies...>::check_for_write_lock(const std::thread::id &, std::false_type)
+{
+    return false;
+}
+
+template <class... Policies>
+bool basic_recursive_shared_mutex<Policies...>::check_for_write_unlock(const std::thread::id &locking_thread_id)
+{
+    if (check_for_write_lock(locking_thread_id))
+    {
+        if (this->_shared_while_exclusive_counter == 0 && policies::debug_assertions)
+        {
+            throw std::logic_error("can not unlock_shared more times than we locked for shared ownership while holding "
+                                   "exclusive ownership");
+        }
+        return true;
+    }
+    return false;
+}
+
+// @return true if the calling thread already had exclusive ownership and now holds it once more
+template <class... Policies>
+bool basic_recursive_shared_mutex<Policies...>::lock_recursive(const std::thread::id &locking_thread_id,
+    std::true_type)
+{
+    if (check_for_write_lock(locking_thread_id))
+    {
+        this->_write_counter++;
+        return true;
+    }
+    return false;
+}
+
+template <class... Policies>
+bool basic_recursive_shared_mutex<Policies...>::lock_recursive(const std::thread::id &locking_thread_id,
+    std::false_type)
+{
+    if (policies::debug_assertions && check_for_write_lock(locking_thread_id))
+    {
+        throw std::logic_error("exclusive ownership can not be locked recursively without the recursion policy");
+    }
+    return false;
+}
+
+// @return true if the calling thread has exclusive ownership and now holds one more shared lock with it
+template <class... Policies>
+bool basic_recursive_shared_mutex<Policies...>::lock_shared_while_exclusive(const std::thread::id &locking_thread_id,
+    std::true_type)
+{
+    if (check_for_write_lock(locking_thread_id))
+    {
+        this->_shared_while_exclusive_counter++;
+        return true;
+    }
+    return false;
+}
+
+template <class... Policies>
+bool basic_recursive_shared_mutex<Policies...>::lock_shared_while_exclusive(const std::thread::id &locking_thread_id,
+    std::false_type)
+{
+    if (policies::debug_assertions && check_for_write_lock(locking_thread_id))
+    {
+        throw std::logic_error("the exclusive owner can not lock_shared without the recursion policy");
+    }
+    return false;
+}
+
+template <class... Policies>
+void basic_recursive_shared_mutex<Policies...>::set_write_owner(const std::thread::id &owner_id, std::true_type)
+{
+    this->_write_owner_id.store(owner_id, std::memory_order_relaxed);
+}
+
+template <class... Policies>
+void basic_recursive_shared_mutex<Policies...>::set_write_owner(const std::thread::id &, std::false_type)
+{
+}
+
+// must be called right after WRITER_HELD was set, by the new owner or by the thread handing ownership to it
+template <class... Policies>
+void basic_recursive_shared_mutex<Policies...>::take_exclusive_ownership(const std::thread::id &locking_thread_id)
+{
+    set_write_owner(locking_thread_id, owner_tracking_enabled());
+    lock_recursive_count(recursion_enabled());
+    // reading the clock costs about as much as an uncontended lock, so only time some of the exclusive
+    // ownerships and only when the result can be used for spinning
+    if (rsm_max_spinning_threads != 0 && (_exclusive_acquisitions++ % HOLD_SAMPLE_INTERVAL) == 0)
+    {
+        _exclusive_since_ns.store(rsm_steady_now_ns(), std::memory_order_relaxed);
+    }
+}
+
+template <class... Policies>
+void basic_recursive_shared_mutex<Policies...>::lock_recursive_count(std::true_type)
+{
+    this->_write_counter++;
+}
+
+template <class... Policies>
+void basic_recursive_shared_mutex<Policies...>::lock_recursive_count(std::false_type)
+{
+}
+
+// must be called by the thread with exclusive ownership
+// @return true if it got exclusive ownership through promotion. Other threads can be queued for promotion
+// while waiting for us to release exclusive ownership.
+template <class... Policies>
+bool basic_recursive_shared_mutex<Policies...>::holds_promotion(std::true_type)
+{
+    return (this->_promoted_id == std::this_thread::get_id());
+}
+
+template <class... Policies>
+bool basic_recursive_shared_mutex<Policies...>::holds_promotion(std::false_type)
+{
+    return false;
+}
+
+// must be called with _mutex locked by the thread with exclusive ownership when it gives it up
+// @return PROMOTION_PENDING if the exclusive owner got its ownership through promotion and no other thread
+// is queued for promotion, the bit has to be cleared together with WRITER_HELD
+template <class... Policies>
+uint64_t basic_recursive_shared_mutex<Policies...>::end_promotion(std::true_type)
+{
+    if (!holds_promotion(promotion_enabled()))
+    {
+        return 0;
+    }
+    this->_promoted_id = NON_THREAD_ID;
+    return (this->_promotion_queue_head == nullptr) ? PROMOTION_PENDING : 0;
+}
+
+template <class... Policies>
+uint64_t basic_recursive_shared_mutex<Policies...>::end_promotion(std::false_type)
+{
+    return 0;
+}
+
+// must be called by the thread with exclusive ownership when it gives up exclusive ownership
+template <class... Policies>
+void basic_recursive_shared_mutex<Policies...>::end_exclusive_timing()
+{
+    const int64_t exclusive_since_ns = _exclusive_since_ns.load(std::memory_order_relaxed);
+    if (exclusive_since_ns != 0)
+    {
+        // only the owner updates the average so a plain load and store is enough
+        const int64_t held_ns = rsm_steady_now_ns() - exclusive_since_ns;
+        const int64_t average_ns = _average_hold_ns.load(std::memory_order_relaxed);
+        _average_hold_ns.store(average_ns + (held_ns - average_ns) / 8, std::memory_order_relaxed);
+        _exclusive_since_ns.store(0, std::memory_order_relaxed);
+    }
+}
+
+// must be called by the new exclusive owner before it changes any of the data the mutex protects. An optimistic
+// reader that sees one of those changes then also sees WRITER_HELD or a newer write generation in
+// read_validate(), the acquire on _state alone does not keep our later stores from becoming visible first
+template <class... Policies>
+void basic_recursive_shared_mutex<Policies...>::publish_exclusive_ownership()
+{
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+// must be called with _mutex locked by the thread with exclusive ownership before WRITER_HELD is cleared,
+// so whoever gets ownership next also sees the new generation
+template <class... Policies>
+void basic_recursive_shared_mutex<Policies...>::end_write_generation()
+{
+    // release so an optimistic reader that reads the new generation also sees everything we wrote
+    _write_generation.store(_write_generation.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+// must be called with _mutex locked by the thread with exclusive ownership
+template <class... Policies>
+void basic_recursive_shared_mutex<Policies...>::release_exclusive_ownership()
+{
+    end_exclusive_timing();
+    // reset the write owner id back to a non thread id once we unlock all write locks
+    set_write_owner(NON_THREAD_ID, owner_tracking_enabled());
+    end_write_generation();
+    _state.fetch_and(~(WRITER_HELD | end_promotion(promotion_enabled())), std::memory_order_release);
+    wake_next_owner();
+}
+
+// must be called with _mutex locked
+template <class... Policies>
+void basic_recursive_shared_mutex<Policies...>::admit_parked_readers()
+{
+    // the parked readers do not hold shared ownership yet so each of them adds exactly one shared owner. with
+    // the cohort policy only the ones on the cohort node might be admitted
+    const uint64_t admitted = this->cohort_admit_readers(_exclusive_queue_head != nullptr, _readers_parked);
+    _state.fetch_add(admitted, std::memory_order_relaxed);
+    _readers_parked -= admitted;
+    _reader_batch++;
+    _read_gate.notify_all();
+}
+
+// must be called with _mutex locked, true if the parked readers should be admitted before the next writer
+template <class... Policies>
+bool basic_recursive_shared_mutex<Policies...>::readers_go_next(const uint64_t &state)
+{
+    if (_readers_parked == 0)
+    {
+        return false;
+    }
+    switch (policies::fairness)
+    {
+    case rsm_fairness::reader_preferring:
+        return true;
+    case rsm_fairness::writer_preferring:
+        return _exclusive_queue_head == nullptr;
+    default:
+        // a writer is next in line once it has set WRITER_WAITING, the readers that were already parked when
+        // it started waiting went in before it
+        return (state & WRITER_WAITING) == 0;
+    }
+}
+
+// must be called with _mutex locked when PROMOTION_PENDING is set and nobody has exclusive ownership.
+// the candidate at the head of the queue goes once the only shared owners left are queued candidates
+template <class... Policies>
+void basic_recursive_shared_mutex<Policies...>::hand_off_promotion(const uint64_t &state, std::true_type)
+{
+    promotion_candidate *candidate = this->_promotion_queue_head;
+    if (candidate == nullptr || shared_owners(state) != this->_promotion_candidate_readers.load())
+    {
+        return;
+    }
+    // new shared owners are blocked and the candidates are waiting, so no other bit can change under us
+    _state.fetch_or(WRITER_HELD, std::memory_order_acquire);
+    remove_waiter(this->_promotion_queue_head, this->_promotion_queue_tail, candidate);
+    this->_promotion_candidate_readers.fetch_sub(candidate->readers);
+    this->_promoted_id = candidate->thread_id;
+    // usually handed off by another thread, so the node is the one the candidate queued on
+    this->cohort_exclusive_taken(candidate->node);
+    take_exclusive_ownership(candidate->thread_id);
+    candidate->granted = true;
+    candidate->gate.notify_one();
+}
+
+template <class... Policies>
+void basic_recursive_shared_mutex<Policies...>::hand_off_promotion(const uint64_t &, std::false_type)
+{
+}
+
+template <class... Policies>
+uint64_t basic_recursive_shared_mutex<Policies...>::queued_candidate_readers(std::true_type)
+{
+    return this->_promotion_candidate_readers.load();
+}
+
+template <class... Policies>
+uint64_t basic_recursive_shared_mutex<Policies...>::queued_candidate_readers(std::false_type)
+{
+    return 0;
+}
+
+// must be called with _mutex locked by a candidate that gave up waiting
+template <class... Policies>
+void basic_recursive_shared_mutex<Policies...>::remove_promotion_candidate(promotion_candidate *candidate)
+{
+    remove_waiter(this->_promotion_queue_head, this->_promotion_queue_tail, candidate);
+    this->_promotion_candidate_readers.fetch_sub(candidate->readers);
+    // PROMOTION_PENDING stays while a promoted thread has exclusive ownership, it clears the bit itself
+    if (this->_promotion_queue_head == nullptr && this->_promoted_id == NON_THREAD_ID)
+    {
+        _state.fetch_and(~PROMOTION_PENDING);
+    }
+}
+
+// update ownership can be taken whenever a new reader could get in and nobody else has it
+template <class... Policies>
+void basic_recursive_shared_mutex<Policies...>::wake_update_waiter(std::true_type)
+{
+    if (this->_update_waiters != 0 && (_state.load() & (READER_BLOCKED | UPDATE_HELD)) == 0)
+    {
+        this->_update_gate.notify_one();
+    }
+}
+
+template <class... Policies>
+void basic_recursive_shared_mutex<Policies...>::wake_update_waiter(std::false_type)
+{
+}
+
+// must be called with _mutex locked after any change to _state that might let a parked thread proceed.
+// only wakes threads that can take ownership right away
+template <class... Policies>
+void basic_recursive_shared_mutex<Policies...>::wake_next_owner()
+{
+    const uint64_t state = _state.load();
+    if (state & WRITER_HELD)
+    {
+        return;
+    }
+    if (policies::promotion && (state & PROMOTION_PENDING))
+    {
+        // the queued promotion candidates go next, everyone else waits for them
+        hand_off_promotion(state, promotion_enabled());
+        return;
+    }
+    if (readers_go_next(state))
+    {
+        admit_parked_readers();
+        // let the whole batch of readers in, then the next writer. unless readers are preferred new readers
+        // are blocked from now on so that the writer does not have to wait for anyone that was not already waiting
+        if (_exclusive_queue_head != nullptr)
+        {
+            _state.fetch_or(WRITER_WAITING);
+        }
+    }
+    else if (_exclusive_queue_head != nullptr)
+    {
+        if ((state & WRITER_WAITING) == 0)
+        {
+            _state.fetch_or(WRITER_WAITING);
+        }
+        if (shared_owners(state) == 0)
+        {
+            hand_off_exclusive_ownership();
+        }
+    }
+    wake_update_waiter(promotion_enabled());
+}
+
+// must be called with _mutex locked when the exclusive queue is not empty and WRITER_WAITING is set
+// @return false if a new reader got in first, it wakes us again once it leaves
+template <class... Policies>
+bool basic_recursive_shared_mutex<Policies...>::hand_off_exclusive_ownership()
+{
+    // no other bit can change without _mutex, only a reader_preferring mutex lets new readers in here.
+    // the remaining waiters set WRITER_WAITING again when this ownership ends
+    uint64_t expected = WRITER_WAITING;
+    if (!_state.compare_exchange_strong(expected, WRITER_HELD, std::memory_order_acquire))
+    {
+        return false;
+    }
+    if (this->sharded_readers() != 0)
+    {
+        // a reader of a reader_preferring mutex got into its shard after we counted, it sees WRITER_HELD
+        // or WRITER_WAITING when it leaves and wakes us again
+        _state.fetch_xor(WRITER_HELD | WRITER_WAITING);
+        return false;
+    }
+    exclusive_waiter *waiter = this->next_exclusive_waiter(_exclusive_queue_head);
+    remove_waiter(_exclusive_queue_head, _exclusive_queue_tail, waiter);
+    this->cohort_exclusive_taken(waiter->node);
+    take_exclusive_ownership(waiter->thread_id);
+    waiter->granted = true;
+    waiter->gate.notify_one();
+    return true;
+}
+
+// the waiting thread queues are singly linked lists of waiters on their threads stacks, they are only
+// changed with _mutex locked
+template <class... Policies>
+template <class Waiter>
+void basic_recursive_shared_mutex<Policies...>::push_waiter(Waiter *&head, Waiter *&tail, Waiter *waiter)
+{
+    if (tail == nullptr)
+    {
+        head = waiter;
+    }
+    else
+    {
+        tail->next = waiter;
+    }
+    tail = waiter;
+}
+
+template <class... Policies>
+template <class Waiter>
+void basic_recursive_shared_mutex<Policies...>::remove_waiter(Waiter *&head, Waiter *&tail, Waiter *waiter)
+{
+    Waiter *previous = nullptr;
+    for (Waiter *it = head; it != waiter; it = it->next)
+    {
+        previous = it;
+    }
+    if (previous == nullptr)
+    {
+        head = waiter->next;
+    }
+    else
+    {
+        previous->next = waiter->next;
+    }
+    if (tail == waiter)
+    {
+        tail = previous;
+    }
+}
+
+template <class... Policies>
+int64_t basic_recursive_shared_mutex<Policies...>::spin_budget_ns()
+{
+    const int64_t average_ns = _average_hold_ns.load(std::memory_order_relaxed);
+    if (rsm_max_spinning_threads == 0 || average_ns > RSM_MAX_SPIN_NS)
+    {
+        return 0;
+    }
+    return std::min<int64_t>(std::max<int64_t>(average_ns * 4, RSM_MIN_SPIN_NS), RSM_MAX_SPIN_NS);
+}
+
+// spin with backoff until ready() returns true or the spin budget runs out
+// @return the last result of ready()
+template <class... Policies>
+template <class Predicate>
+bool basic_recursive_shared_mutex<Policies...>::spin_until(Predicate ready)
+{
+    const int64_t budget_ns = spin_budget_ns();
+    if (budget_ns == 0)
+    {
+        return ready();
+    }
+    if (rsm_spinning_threads.fetch_add(1, std::memory_order_relaxed) >= rsm_max_spinning_threads)
+    {
+        rsm_spinning_threads.fetch_sub(1, std::memory_order_relaxed);
+        return ready();
+    }
+    const int64_t start_ns = rsm_steady_now_ns();
+    rsm_backoff backoff;
+    bool result = ready();
+    while (!result)
+    {
+        const int64_t now_ns = rsm_steady_now_ns();
+        if (now_ns - start_ns > budget_ns)
+        {
+            break;
+        }
+        // the owner has already held on for longer than we are willing to spin, it is either
+        // descheduled or in an unusually long section so waiting for it here only wastes cpu
+        const int64_t exclusive_since_ns = _exclusive_since_ns.load(std::memory_order_relaxed);
+        if (exclusive_since_ns != 0 && now_ns - exclusive_since_ns > budget_ns)
+        {
+            break;
+        }
+        backoff.pause();
+        result = ready();
+    }
+    rsm_spinning_threads.fetch_sub(1, std::memory_order_relaxed);
+    return result;
+}
+
+template <class... Policies>
+uint64_t &basic_recursive_shared_mutex<Policies...>::shared_count_for_this_thread()
+{
+    return rsm_shared_lock_counts.get_or_insert(this);
+}
+
+template <class... Policies>
+bool basic_recursive_shared_mutex<Policies...>::already_has_lock_shared()
+{
+    return (rsm_shared_lock_counts.find(this) != nullptr);
+}
+
+template <class... Policies>
+uint64_t basic_recursive_shared_mutex<Policies...>::promotion_candidate_readers(std::true_type)
+{
+    return already_has_lock_shared() ? 1 : 0;
+}
+
+// without recursion shared locks are not tracked per thread, the candidate has to be a shared owner
+template <class... Policies>
+uint64_t basic_recursive_shared_mutex<Policies...>::promotion_candidate_readers(std::false_type)
+{
+    return 1;
+}
+
+template <class... Policies>
+bool basic_recursive_shared_mutex<Policies...>::try_lock_shared_recursive(std::true_type)
+{
+    uint64_t *our_shared_count = rsm_shared_lock_counts.find(this);
+    if (our_shared_count == nullptr)
+    {
+        return false;
+    }
+    *our_shared_count = *our_shared_count + 1;
+    return true;
+}
+
+template <class... Policies>
+bool basic_recursive_shared_mutex<Policies...>::try_lock_shared_recursive(std::false_type)
+{
+    return false;
+}
+
+template <class... Policies>
+void basic_recursive_shared_mutex<Policies...>::record_shared_lock(std::true_type)
+{
+    shared_count_for_this_thread() = 1;
+}
+
+template <class... Policies>
+void basic_recursive_shared_mutex<Policies...>::record_shared_lock(std::false_type)
+{
+}
+
+// the state word only counts threads with shared ownership, recursive shared locks are only counted in the
+// thread local rsm_shared_lock_counts so they never touch memory shared with other threads
+template <class... Policies>
+void basic_recursive_shared_mutex<Policies...>::lock_shared_internal(const uint64_t &count)
+{
+    uint64_t &our_shared_count = shared_count_for_this_thread();
+    if (our_shared_count == 0)
+    {
+        _state.fetch_add(1, std::memory_order_acquire);
+    }
+    our_shared_count = our_shared_count + count;
+}
+
+template <class... Policies>
+void basic_recursive_shared_mutex<Policies...>::unlock_shared_internal(const uint64_t &count)
+{
+    uint64_t *our_shared_count = rsm_shared_lock_counts.find(this);
+    if (our_shared_count == nullptr || *our_shared_count < count)
+    {
+        if (policies::debug_assertions)
+        {
+            throw std::logic_error("can not unlock_shared more times than we locked for shared ownership");
+        }
+        return;
+    }
+    *our_shared_count = *our_shared_count - count;
+    if (*our_shared_count != 0)
+    {
+        return;
+    }
+    rsm_shared_lock_counts.erase(this);
+    release_shared_ownership();
+}
+
+template <class... Policies>
+void basic_recursive_shared_mutex<Policies...>::release_shared_ownership()
+{
+    if (release_sharded_ownership(sharding_enabled()))
+    {
+        return;
+    }
+    // sequentially consistent together with the queueing of a promotion candidate, either we see the
+    // candidate or it sees that we left
+    const uint64_t previous_state = _state.fetch_sub(1);
+    const uint64_t readers = (previous_state - 1) & READER_MASK;
+    // a waiting writer needs all shared owners to leave and the first promotion candidate all but the
+    // queued candidates, there is nobody to wake before then
+    if (((previous_state & WRITER_WAITING) && readers == 0) ||
+        ((previous_state & PROMOTION_PENDING) && readers <= queued_candidate_readers(promotion_enabled())))
+    {
+        std::lock_guard<rsm_internal_mutex> _lock(_mutex);
+        wake_next_owner();
+    }
+}
+
+template <class... Policies>
+bool basic_recursive_shared_mutex<Policies...>::try_lock_shared_fast()
+{
+    return try_lock_shared_fast(sharding_enabled());
+}
+
+template <class... Policies>
+bool basic_recursive_shared_mutex<Policies...>::try_lock_shared_fast(std::true_type)
+{
+    if (_state.load(std::memory_order_relaxed) & READER_BLOCKED)
+    {
+        return false;
+    }
+    const size_t index = this->reader_shard_index();
+    this->enter_reader_shard(index);
+    if ((_state.load() & READER_BLOCKED) != 0)
+    {
+        leave_reader_shard(index);
+        return false;
+    }
+    record_shared_lock(recursion_enabled());
+    rsm_reader_shard_slots.get_or_insert(this) = index + 1;
+    return true;
+}
+
+template <class... Policies>
+bool basic_recursive_shared_mutex<Policies...>::try_lock_shared_fast(std::false_type)
+{
+    return try_lock_shared_central();
+}
+
+// threads that waited for shared ownership are counted in the state word even with reader shards, this is
+// also the only way to get it with _mutex locked because leaving a shard might have to lock it
+template <class... Policies>
+bool basic_recursive_shared_mutex<Policies...>::try_lock_shared_central()
+{
+    uint64_t state = _state.load(std::memory_order_relaxed);
+    while ((state & READER_BLOCKED) == 0)
+    {
+        if (_state.compare_exchange_weak(state, state + 1, std::memory_order_acquire, std::memory_order_relaxed))
+        {
+            record_shared_lock(recursion_enabled());
+            return true;
+        }
+    }
+    return false;
+}
+
+// @return the number of threads with shared ownership, not counting the thread with exclusive ownership
+template <class... Policies>
+uint64_t basic_recursive_shared_mutex<Policies...>::shared_owners(const uint64_t &state)
+{
+    return (state & READER_MASK) + this->sharded_readers();
+}
+
+// must be called without _mutex locked
+template <class... Policies>
+void basic_recursive_shared_mutex<Policies...>::leave_reader_shard(const size_t &index)
+{
+    this->exit_reader_shard(index);
+    // Counting the shards is not cheap so unlike release_shared_ownership() we do not find out if we were
+    // the last one a waiting thread needed to leave, we wake whoever might be. WRITER_HELD is only seen here
+    // while a writer that counted us is finding out that it has to wait after all.
+    if (_state.load() & (WRITER_HELD | WRITER_WAITING | PROMOTION_PENDING))
+    {
+        std::lock_guard<rsm_internal_mutex> _lock(_mutex);
+        wake_next_owner();
+    }
+}
+
+// @return true if the calling thread had its shared ownership through a reader shard and left it
+template <class... Policies>
+bool basic_recursive_shared_mutex<Policies...>::release_sharded_ownership(std::true_type)
+{
+    uint64_t *slot = rsm_reader_shard_slots.find(this);
+    if (slot == nullptr)
+    {
+        return false;
+    }
+    const size_t index = static_cast<size_t>(*slot - 1);
+    rsm_reader_shard_slots.erase(this);
+    leave_reader_shard(index);
+    return true;
+}
+
+template <class... Policies>
+bool basic_recursive_shared_mutex<Policies...>::release_sharded_ownership(std::false_type)
+{
+    return false;
+}
+
+template <class... Policies>
+template <class Predicate>
+bool basic_recursive_shared_mutex<Policies...>::wait_on_gate(rsm_internal_condition &gate,
+    std::unique_lock<rsm_internal_mutex> &lock,
+    const std::chrono::steady_clock::time_point *deadline,
+    Predicate ready)
+{
+    if (deadline == nullptr)
+    {
+        gate.wait(lock, ready);
+        return true;
+    }
+    return gate.wait_until(lock, *deadline, ready);
+}
+
+template <class... Policies>
+bool basic_recursive_shared_mutex<Policies...>::lock_until_steady(const std::chrono::steady_clock::time_point *deadline)
+{
+    const std::thread::id &locking_thread_id = std::this_thread::get_id();
+    if (lock_recursive(locking_thread_id, recursion_enabled()))
+    {
+        return true;
+    }
+    const bool unowned = spin_until([this] {
+        return _state.load(std::memory_order_relaxed) == 0 && this->sharded_readers() == 0;
+    });
+    std::unique_lock<rsm_internal_mutex> _lock(_mutex);
+    uint64_t expected = 0;
+    if (unowned && _state.compare_exchange_strong(expected, WRITER_HELD, std::memory_order_acquire))
+    {
+        if (this->sharded_readers() == 0)
+        {
+            take_exclusive_ownership(locking_thread_id);
+            this->cohort_exclusive_taken(this->cohort_node());
+            publish_exclusive_ownership();
+            return true;
+        }
+        // a reader got into its shard before it could see us, wait in line for it to leave
+        _state.fetch_and(~WRITER_HELD);
+    }
+    // Get in line and block new readers unless another writer already did. Whoever releases ownership
+    // while we are at the head of the queue and no shared owners are left makes us the owner.
+    exclusive_waiter waiter(locking_thread_id, this->cohort_node());
+    push_waiter(_exclusive_queue_head, _exclusive_queue_tail, &waiter);
+    if ((_state.load() & WRITER_WAITING) == 0)
+    {
+        _state.fetch_or(WRITER_WAITING);
+    }
+    // the shared owners might have left before we got in line
+    wake_next_owner();
+    if (!wait_on_gate(waiter.gate, _lock, deadline, [&waiter] { return waiter.granted; }))
+    {
+        remove_waiter(_exclusive_queue_head, _exclusive_queue_tail, &waiter);
+        // WRITER_WAITING is only there for the threads in the queue, if we were the last one
+        // stop blocking new readers and let in the ones that parked behind us
+        if (_exclusive_queue_head == nullptr)
+        {
+            _state.fetch_and(~WRITER_WAITING);
+        }
+        wake_next_owner();
+        return false;
+    }
+    publish_exclusive_ownership();
+    return true;
+}
+
+template <class... Policies>
+bool basic_recursive_shared_mutex<Policies...>::try_promotion_until_steady(
+    const std::chrono::steady_clock::time_point *deadline)
+{
+    static_assert(policies::promotion, "try_promotion needs the promotion policy");
+    const std::thread::id &locking_thread_id = std::this_thread::get_id();
+    if (lock_recursive(locking_thread_id, recursion_enabled()))
+    {
+        return true;
+    }
+    std::unique_lock<rsm_internal_mutex> _lock(_mutex);
+    promotion_candidate candidate(
+        locking_thread_id, promotion_candidate_readers(recursion_enabled()), this->cohort_node());
+    // counted before PROMOTION_PENDING is set so a shared owner that sees the bit when it leaves also
+    // sees us as a candidate
+    this->_promotion_candidate_readers.fetch_add(candidate.readers);
+    // the thread with update ownership is guaranteed the next promotion. update ownership is taken without
+    // _mutex and only while PROMOTION_PENDING is clear, so only one of us can get in
+    uint64_t state = _state.load();
+    do
+    {
+        if ((state & UPDATE_HELD) && this->_update_owner_id.load(std::memory_order_relaxed) != locking_thread_id)
+        {
+            this->_promotion_candidate_readers.fetch_sub(candidate.readers);
+            return false;
+        }
+    } while (!_state.compare_exchange_weak(state, state | PROMOTION_PENDING));
+    // Then wait in line until every shared owner that is not a candidate has left. A thread waiting in lock()
+    // might still have WRITER_WAITING set, it can not get exclusive ownership while PROMOTION_PENDING is set
+    // so we cut the line. Whoever sees that we can go makes us the owner.
+    push_waiter(this->_promotion_queue_head, this->_promotion_queue_tail, &candidate);
+    wake_next_owner();
+    if (!wait_on_gate(candidate.gate, _lock, deadline, [&candidate] { return candidate.granted; }))
+    {
+        // leave the queue, whoever we were blocking can go ahead now
+        remove_promotion_candidate(&candidate);
+        wake_next_owner();
+        return false;
+    }
+    publish_exclusive_ownership();
+    return true;
+}
+
+template <class... Policies>
+bool basic_recursive_shared_mutex<Policies...>::lock_shared_until_steady(
+    const std::chrono::steady_clock::time_point *deadline)
+{
+    const std::thread::id &locking_thread_id = std::this_thread::get_id();
+    if (lock_shared_while_exclusive(locking_thread_id, recursion_enabled()))
+    {
+        return true;
+    }
+    if (try_lock_shared_recursive(recursion_enabled()) || try_lock_shared_fast())
+    {
+        return true;
+    }
+    if (spin_until([this] { return (_state.load(std::memory_order_relaxed) & READER_BLOCKED) == 0; }) &&
+        try_lock_shared_fast())
+    {
+        return true;
+    }
+    std::unique_lock<rsm_internal_mutex> _lock(_mutex);
+    if (try_lock_shared_central())
+    {
+        return true;
+    }
+    // Park until a thread clearing the blocking bits admits us together with every other parked reader, or
+    // every other one on our numa node with the cohort policy. It adds us to _state so there is nothing left
+    // to race for when we wake up.
+    const size_t node = this->cohort_node();
+    const uint64_t batch = _reader_batch;
+    const uint64_t node_batch = this->cohort_reader_batch(node);
+    _readers_parked++;
+    this->cohort_park_reader(node);
+    if (!wait_on_gate(_read_gate, _lock, deadline, [this, batch, node, node_batch] {
+            return _reader_batch != batch && this->cohort_reader_admitted(node, node_batch);
+        }))
+    {
+        // admitting readers needs _mutex so we can not have been admitted since the last check
+        _readers_parked--;
+        this->cohort_unpark_reader(node);
+        return false;
+    }
+    record_shared_lock(recursion_enabled());
+    return true;
+}
+
+template <class... Policies>
+void basic_recursive_shared_mutex<Policies...>::unlock(std::true_type)
+{
+    const std::thread::id &locking_thread_id = std::this_thread::get_id();
+    // you cannot unlock if you are not the write owner so check that here
+    if (!check_for_write_lock(locking_thread_id) || this->_write_counter == 0)
+    {
+        if (policies::debug_assertions)
+        {
+            throw std::logic_error("unlock(standard logic) incorrectly called on a thread with no exclusive lock");
+        }
+        return;
+    }
+    this->_write_counter--;
+    if (this->_write_counter != 0)
+    {
+        return;
+    }
+    std::lock_guard<rsm_internal_mutex> _lock(_mutex);
+    if (holds_promotion(promotion_enabled()))
+    {
+        // a promoted thread goes back to the shared ownership it had before it was promoted, any shared locks
+        // it took while promoted become shared locks as well
+        if (this->_shared_while_exclusive_counter > 0)
+        {
+            lock_shared_internal(this->_shared_while_exclusive_counter);
+            this->_shared_while_exclusive_counter = 0;
+        }
+        release_exclusive_ownership();
+    }
+    else if (end_of_exclusive_ownership())
+    {
+        release_exclusive_ownership();
+    }
+}
+
+// without recursion there is exactly one exclusive lock, a promoted thread keeps the shared lock it had
+template <class... Policies>
+void basic_recursive_shared_mutex<Policies...>::unlock(std::false_type)
+{
+    if (policies::owner_tracking && !check_for_write_lock(std::this_thread::get_id()))
+    {
+        if (policies::debug_assertions)
+        {
+            throw std::logic_error("unlock(standard logic) incorrectly called on a thread with no exclusive lock");
+        }
+        return;
+    }
+    std::lock_guard<rsm_internal_mutex> _lock(_mutex);
+    release_exclusive_ownership();
+}
+
+template <class... Policies>
+void basic_recursive_shared_mutex<Policies...>::unlock_shared(std::true_type)
+{
+    const std::thread::id &locking_thread_id = std::this_thread::get_id();
+    if (check_for_write_unlock(locking_thread_id))
+    {
+        if (this->_shared_while_exclusive_counter == 0)
+        {
+            return;
+        }
+        this->_shared_while_exclusive_counter--;
+        if (end_of_exclusive_ownership())
+        {
+            std::lock_guard<rsm_internal_mutex> _lock(_mutex);
+            release_exclusive_ownership();
+        }
+        return;
+    }
+    unlock_shared_internal();
+}
+
+template <class... Policies>
+void basic_recursive_shared_mutex<Policies...>::unlock_shared(std::false_type)
+{
+    if (policies::debug_assertions && (_state.load(std::memory_order_relaxed) & READER_MASK) == 0)
+    {
+        throw std::logic_error("can not unlock_shared more times than we locked for shared ownership");
+    }
+    release_shared_ownership();
+}
+
+// moves every exclusive and shared lock of the exclusive owner into its thread local shared lock count
+// @return the number of shared owners to add to _state, 0 if the thread was already counted as one
+template <class... Policies>
+uint64_t basic_recursive_shared_mutex<Policies...>::downgrade_exclusive_locks(std::true_type)
+{
+    uint64_t &our_shared_count = shared_count_for_this_thread();
+    const uint64_t new_shared_owners = (our_shared_count == 0) ? 1 : 0;
+    our_shared_count = our_shared_count + this->_write_counter + this->_shared_while_exclusive_counter;
+    this->_write_counter = 0;
+    this->_shared_while_exclusive_counter = 0;
+    return new_shared_owners;
+}
+
+// without recursion the one exclusive lock becomes one more shared lock
+template <class... Policies>
+uint64_t basic_recursive_shared_mutex<Policies...>::downgrade_exclusive_locks(std::false_type)
+{
+    return 1;
+}
+
+// @return true if the calling thread has update ownership and now holds it once more
+template <class... Policies>
+bool basic_recursive_shared_mutex<Policies...>::lock_update_recursive(const std::thread::id &locking_thread_id)
+{
+    if (this->_update_owner_id.load(std::memory_order_relaxed) == locking_thread_id)
+    {
+        if (!policies::recursion && policies::debug_assertions)
+        {
+            throw std::logic_error("update ownership can not be locked recursively without the recursion policy");
+        }
+        this->_update_counter++;
+        return true;
+    }
+    return lock_shared_while_exclusive(locking_thread_id, recursion_enabled());
+}
+
+template <class... Policies>
+bool basic_recursive_shared_mutex<Policies...>::has_lock_shared(std::true_type)
+{
+    return already_has_lock_shared();
+}
+
+// without recursion shared locks are not tracked, every update lock is a new shared lock
+template <class... Policies>
+bool basic_recursive_shared_mutex<Policies...>::has_lock_shared(std::false_type)
+{
+    return false;
+}
+
+template <class... Policies>
+bool basic_recursive_shared_mutex<Policies...>::try_lock_update_fast(const std::thread::id &locking_thread_id)
+{
+    // a thread that already has shared ownership is not blocked by a waiting writer, same as a recursive
+    // lock_shared(). it only needs the update slot and no promotion in progress
+    const bool shared_owner = has_lock_shared(recursion_enabled());
+    const uint64_t blocked = shared_owner ? (PROMOTION_PENDING | UPDATE_HELD) : (READER_BLOCKED | UPDATE_HELD);
+    const uint64_t change = shared_owner ? UPDATE_HELD : (UPDATE_HELD + 1);
+    uint64_t state = _state.load(std::memory_order_relaxed);
+    while ((state & blocked) == 0)
+    {
+        if (_state.compare_exchange_weak(state, state + change, std::memory_order_acquire, std::memory_order_relaxed))
+        {
+            add_update_shared_lock(recursion_enabled());
+            this->_update_owner_id.store(locking_thread_id, std::memory_order_relaxed);
+            this->_update_counter = 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+// update ownership comes with one shared lock, counted like any other shared lock of this thread
+template <class... Policies>
+void basic_recursive_shared_mutex<Policies...>::add_update_shared_lock(std::true_type)
+{
+    uint64_t &our_shared_count = shared_count_for_this_thread();
+    our_shared_count = our_shared_count + 1;
+}
+
+template <class... Policies>
+void basic_recursive_shared_mutex<Policies...>::add_update_shared_lock(std::false_type)
+{
+}
+
+// gives up the shared lock that came with update ownership
+// @return 1 if the thread is no longer a shared owner
+template <class... Policies>
+uint64_t basic_recursive_shared_mutex<Policies...>::drop_update_shared_lock(std::true_type)
+{
+    uint64_t *our_shared_count = rsm_shared_lock_counts.find(this);
+    *our_shared_count = *our_shared_count - 1;
+    if (*our_shared_count != 0)
+    {
+        return 0;
+    }
+    rsm_shared_lock_counts.erase(this);
+    return release_sharded_ownership(sharding_enabled()) ? 0 : 1;
+}
+
+template <class... Policies>
+uint64_t basic_recursive_shared_mutex<Policies...>::drop_update_shared_lock(std::false_type)
+{
+    return 1;
+}
+
+////////////////////////
+///
+/// Public Functions
+///
+
+template <class... Policies>
+void basic_recursive_shared_mutex<Policies...>::lock()
+{
+    lock_until_steady(nullptr);
+}
+
+template <class... Policies>
+bool basic_recursive_shared_mutex<Policies...>::try_promotion()
+{
+    return try_promotion_until_steady(nullptr);
+}
+
+template <class... Policies>
+bool basic_recursive_shared_mutex<Policies...>::try_promotion_no_wait()
+{
+    static_assert(policies::promotion, "try_promotion_no_wait needs the promotion policy");
+    const std::thread::id &locking_thread_id = std::this_thread::get_id();
+    if (lock_recursive(locking_thread_id, recursion_enabled()))
+    {
+        return true;
+    }
+    std::unique_lock<rsm_internal_mutex> _lock(_mutex, std::try_to_lock);
+    if (!_lock.owns_lock())
+    {
+        return false;
+    }
+    // we may be the only shared owner, counted in the state word or in a reader shard. a waiting writer is
+    // still waiting for us to leave, we go first like any other promotion would
+    const uint64_t readers = promotion_candidate_readers(recursion_enabled());
+    uint64_t expected = _state.load() & (READER_MASK | WRITER_WAITING);
+    if (shared_owners(expected) != readers)
+    {
+        return false;
+    }
+    if (this->_update_owner_id.load(std::memory_order_relaxed) == locking_thread_id)
+    {
+        expected |= UPDATE_HELD;
+    }
+    // fails if any other bit is set or a reader came or went in the state word
+    if (!_state.compare_exchange_strong(
+            expected, expected | WRITER_HELD | PROMOTION_PENDING, std::memory_order_acquire))
+    {
+        return false;
+    }
+    // a reader that entered its shard before it could see WRITER_HELD
+    if (shared_owners(expected) != readers)
+    {
+        _state.fetch_and(~(WRITER_HELD | PROMOTION_PENDING));
+        wake_next_owner();
+        return false;
+    }
+    this->_promoted_id = locking_thread_id;
+    take_exclusive_ownership(locking_thread_id);
+    this->cohort_exclusive_taken(this->cohort_node());
+    publish_exclusive_ownership();
+    return true;
+}
+
+template <class... Policies>
+bool basic_recursive_shared_mutex<Policies...>::try_lock()
+{
+    const std::thread::id &locking_thread_id = std::this_thread::get_id();
+    if (lock_recursive(locking_thread_id, recursion_enabled()))
+    {
+        return true;
+    }
+    std::unique_lock<rsm_internal_mutex> _lock(_mutex, std::try_to_lock);
+    if (!_lock.owns_lock())
+    {
+        return false;
+    }
+    uint64_t expected = 0;
+    if (!_state.compare_exchange_strong(expected, WRITER_HELD, std::memory_order_acquire))
+    {
+        return false;
+    }
+    if (this->sharded_readers() != 0)
+    {
+        _state.fetch_and(~WRITER_HELD);
+        wake_next_owner();
+        return false;
+    }
+    take_exclusive_ownership(locking_thread_id);
+    this->cohort_exclusive_taken(this->cohort_node());
+    publish_exclusive_ownership();
+    return true;
+}
+
+template <class... Policies>
+void basic_recursive_shared_mutex<Policies...>::unlock()
+{
+    unlock(recursion_enabled());
+}
+
+template <class... Policies>
+void basic_recursive_shared_mutex<Policies...>::downgrade()
+{
+    if (policies::owner_tracking && !check_for_write_lock(std::this_thread::get_id()))
+    {
+        if (policies::debug_assertions)
+        {
+            throw std::logic_error("downgrade called on a thread with no exclusive lock");
+        }
+        return;
+    }
+    std::lock_guard<rsm_internal_mutex> _lock(_mutex);
+    end_exclusive_timing();
+    set_write_owner(NON_THREAD_ID, owner_tracking_enabled());
+    end_write_generation();
+    // clear WRITER_HELD and add us as a shared owner in one step so no writer can get in between
+    const uint64_t change =
+        downgrade_exclusive_locks(recursion_enabled()) - WRITER_HELD - end_promotion(promotion_enabled());
+    const uint64_t state = _state.fetch_add(change, std::memory_order_release) + change;
+    // a thread that parked in lock_update() while we had exclusive ownership can join us now
+    wake_update_waiter(promotion_enabled());
+    if (policies::promotion && (state & PROMOTION_PENDING))
+    {
+        // another thread is waiting for promotion, it still goes next
+        wake_next_owner();
+        return;
+    }
+    if (_readers_parked != 0)
+    {
+        admit_parked_readers();
+    }
+    if (_exclusive_queue_head != nullptr && (state & WRITER_WAITING) == 0)
+    {
+        _state.fetch_or(WRITER_WAITING);
+    }
+}
+
+template <class... Policies>
+uint64_t basic_recursive_shared_mutex<Policies...>::write_generation() const
+{
+    return _write_generation.load(std::memory_order_acquire);
+}
+
+template <class... Policies>
+bool basic_recursive_shared_mutex<Policies...>::written_since(const uint64_t &generation) const
+{
+    return (_write_generation.load(std::memory_order_acquire) != generation);
+}
+
+template <class... Policies>
+uint64_t basic_recursive_shared_mutex<Policies...>::read_begin() const
+{
+    // a writer that already has ownership leaves the generation unchanged until it is done, read_validate()
+    // fails because of WRITER_HELD in that case
+    return _write_generation.load(std::memory_order_acquire);
+}
+
+template <class... Policies>
+bool basic_recursive_shared_mutex<Policies...>::read_validate(const uint64_t &version) const
+{
+    // keep the reads of the protected data from moving past the checks below
+    std::atomic_thread_fence(std::memory_order_acquire);
+    // a writer bumps the generation before its release clears WRITER_HELD, reading _state with acquire first
+    // means a cleared WRITER_HELD comes with the new generation
+    if ((_state.load(std::memory_order_acquire) & WRITER_HELD) != 0)
+    {
+        return false;
+    }
+    return _write_generation.load(std::memory_order_relaxed) == version;
+}
+
+template <class... Policies>
+void basic_recursive_shared_mutex<Policies...>::lock_update()
+{
+    static_assert(policies::promotion, "update ownership needs the promotion policy");
+    const std::thread::id &locking_thread_id = std::this_thread::get_id();
+    if (lock_update_recursive(locking_thread_id) || try_lock_update_fast(locking_thread_id))
+    {
+        return;
+    }
+    if (policies::debug_assertions && has_lock_shared(recursion_enabled()))
+    {
+        throw std::logic_error("lock_update can deadlock when called with shared ownership, use try_lock_update");
+    }
+    std::unique_lock<rsm_internal_mutex> _lock(_mutex);
+    this->_update_waiters++;
+    this->_update_gate.wait(_lock, [this, &locking_thread_id] { return try_lock_update_fast(locking_thread_id); });
+    this->_update_waiters--;
+}
+
+template <class... Policies>
+bool basic_recursive_shared_mutex<Policies...>::try_lock_update()
+{
+    static_assert(policies::promotion, "update ownership needs the promotion policy");
+    const std::thread::id &locking_thread_id = std::this_thread::get_id();
+    return lock_update_recursive(locking_thread_id) || try_lock_update_fast(locking_thread_id);
+}
+
+template <class... Policies>
+void basic_recursive_shared_mutex<Policies...>::unlock_update()
+{
+    const std::thread::id &locking_thread_id = std::this_thread::get_id();
+    if (this->_update_owner_id.load(std::memory_order_relaxed) != locking_thread_id)
+    {
+        // the exclusive owner counted its update lock as a shared lock
+        if (check_for_write_lock(locking_thread_id))
+        {
+            unlock_shared();
+        }
+        else if (policies::debug_assertions)
+        {
+            throw std::logic_error("unlock_update called on a thread with no update lock");
+        }
+        return;
+    }
+    this->_update_counter--;
+    if (this->_update_counter != 0)
+    {
+        return;
+    }
+    this->_update_owner_id.store(NON_THREAD_ID, std::memory_order_relaxed);
+    const uint64_t change = UPDATE_HELD + drop_update_shared_lock(recursion_enabled());
+    std::lock_guard<rsm_internal_mutex> _lock(_mutex);
+    _state.fetch_sub(change, std::memory_order_release);
+    wake_next_owner();
+}
+
+template <class... Policies>
+void basic_recursive_shared_mutex<Policies...>::upgrade()
+{
+    if (policies::debug_assertions && this->_update_owner_id.load(std::memory_order_relaxed) != std::this_thread::get_id())
+    {
+        throw std::logic_error("upgrade called on a thread with no update lock");
+    }
+    try_promotion_until_steady(nullptr);
+}
+
+template <class... Policies>
+void basic_recursive_shared_mutex<Policies...>::lock_shared()
+{
+    lock_shared_until_steady(nullptr);
+}
+
+template <class... Policies>
+bool basic_recursive_shared_mutex<Policies...>::try_lock_shared()
+{
+    const std::thread::id &locking_thread_id = std::this_thread::get_id();
+    if (lock_shared_while_exclusive(locking_thread_id, recursion_enabled()))
+    {
+        return true;
+    }
+    return try_lock_shared_recursive(recursion_enabled()) || try_lock_shared_fast();
+}
+
+template <class... Policies>
+void basic_recursive_shared_mutex<Policies...>::unlock_shared()
+{
+    unlock_shared(recursion_enabled());
+}
+
+template <class... Policies>
+bool basic_recursive_shared_mutex<Policies...>::has_shared_ownership()
+{
+    return check_for_write_lock(std::this_thread::get_id()) || has_lock_shared(recursion_enabled());
+}
+
+#endif // _RECURSIVE_SHARED_MUTEX_IMPL_H
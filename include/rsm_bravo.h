@@ -0,0 +1,329 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef _RSM_BRAVO_H
+#define _RSM_BRAVO_H
+
+#include "recursive_shared_mutex.h"
+#include "rsm_owner_table.h"
+#include "rsm_spin.h"
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+// number of slots in the visible readers table shared by every rsm_bravo, must be a power of 2
+#ifndef RSM_BRAVO_TABLE_SIZE
+#define RSM_BRAVO_TABLE_SIZE 4096
+#endif
+
+// read bias stays off for this many times as long as the last revocation took
+#ifndef RSM_BRAVO_INHIBIT_MULTIPLIER
+#define RSM_BRAVO_INHIBIT_MULTIPLIER 9
+#endif
+
+static_assert((RSM_BRAVO_TABLE_SIZE & (RSM_BRAVO_TABLE_SIZE - 1)) == 0, "RSM_BRAVO_TABLE_SIZE must be a power of 2");
+
+// Every slot holds the address of the rsm_bravo a reader published itself for, or null. Readers of
+// different locks and different threads hash to different slots so they rarely share a cache line.
+extern std::atomic<const void *> rsm_bravo_visible_readers[RSM_BRAVO_TABLE_SIZE];
+// the number of read sections this thread holds through the visible readers table, per rsm_bravo
+extern thread_local rsm_owner_table<RSM_OWNER_TABLE_CAPACITY> rsm_bravo_read_counts;
+
+/**
+ * Reader biased wrapper around a recursive_shared_mutex, after BRAVO (Biased Locking for
+ * Reader-Writer Locks, Dice and Kogan).
+ *
+ * While the lock is read biased lock_shared() publishes the calling thread in a slot of the global
+ * visible readers table instead of touching the shared owner count of the mutex, so readers on
+ * different cores never write to the same cache line. A thread taking exclusive ownership first gets
+ * it from the mutex as usual, then revokes the bias and waits for every published reader of this lock
+ * to leave. Readers that find the bias revoked or their slot taken use the mutex. The bias is turned
+ * back on by a reader once RSM_BRAVO_INHIBIT_MULTIPLIER times as long as the last revocation took has
+ * passed, so revocations can never cost writers more than about 10% of their time.
+ *
+ * Recursion and try_promotion() work like they do on the mutex. A reader that holds its read section
+ * through the table is not known to the mutex, try_promotion() has to turn that into shared ownership
+ * of the mutex first and returns false if a writer already got in.
+ */
+template <class Mutex = recursive_shared_mutex>
+class rsm_bravo
+{
+private:
+    Mutex _mutex;
+    // readers may publish themselves in the table while this is set
+    std::atomic<bool> _read_bias;
+    // steady clock time in nanoseconds before which readers do not turn the bias back on
+    std::atomic<int64_t> _inhibit_until_ns;
+
+    // The thread with exclusive ownership through this wrapper and how many exclusive locks and shared
+    // locks it took while having it, only changed by that thread. Readers never turn the bias back on
+    // while they are the exclusive owner.
+    std::atomic<std::thread::id> _owner;
+    uint64_t _owner_write_locks;
+    uint64_t _owner_shared_locks;
+    // a promoted owner goes back to shared ownership when its last exclusive lock is released
+    bool _owner_promoted;
+
+    std::atomic<const void *> &slot_for_this_thread()
+    {
+        // the address of a thread local differs for every thread and costs nothing to get
+        const uintptr_t thread_key = reinterpret_cast<uintptr_t>(&rsm_bravo_read_counts);
+        const uintptr_t key = reinterpret_cast<uintptr_t>(this) ^ (thread_key >> 4);
+        return rsm_bravo_visible_readers[(key * UINT64_C(0x9E3779B97F4A7C15)) >> 40 & (RSM_BRAVO_TABLE_SIZE - 1)];
+    }
+
+    bool is_owner() const { return _owner.load(std::memory_order_relaxed) == std::this_thread::get_id(); }
+
+    // @return true if the calling thread now holds a read section through the visible readers table
+    bool try_lock_shared_biased()
+    {
+        uint64_t *our_count = rsm_bravo_read_counts.find(this);
+        if (our_count != nullptr)
+        {
+            *our_count = *our_count + 1;
+            return true;
+        }
+        if (!_read_bias.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        std::atomic<const void *> &slot = slot_for_this_thread();
+        const void *expected = nullptr;
+        if (!slot.compare_exchange_strong(expected, this))
+        {
+            return false;
+        }
+        // sequentially consistent with revoke_bias(), either the writer sees us in the slot or we see
+        // that the bias is gone
+        if (!_read_bias.load())
+        {
+            slot.store(nullptr, std::memory_order_release);
+            return false;
+        }
+        rsm_bravo_read_counts.get_or_insert(this) = 1;
+        return true;
+    }
+
+    // must be called by a thread that just got shared ownership of the mutex
+    void maybe_restore_bias()
+    {
+        if (!_read_bias.load(std::memory_order_relaxed) && !is_owner() &&
+            rsm_steady_now_ns() >= _inhibit_until_ns.load(std::memory_order_relaxed))
+        {
+            _read_bias.store(true);
+        }
+    }
+
+    // must be called by the thread that just got exclusive ownership of the mutex
+    void take_ownership(const bool &promoted)
+    {
+        if (is_owner())
+        {
+            _owner_write_locks++;
+            return;
+        }
+        _owner.store(std::this_thread::get_id(), std::memory_order_relaxed);
+        _owner_write_locks = 1;
+        _owner_shared_locks = 0;
+        _owner_promoted = promoted;
+    }
+
+    // @return true if no published readers were left, with wait set this is always the case
+    bool revoke_bias(const bool &wait)
+    {
+        if (!_read_bias.load(std::memory_order_relaxed))
+        {
+            return true;
+        }
+        _read_bias.store(false);
+        // the other half of the handshake in try_lock_shared_biased(), the scan below must not be ordered
+        // before the store on weakly ordered cpus or a reader publishing right now could be missed
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const int64_t start_ns = rsm_steady_now_ns();
+        bool drained = true;
+        for (size_t i = 0; i < RSM_BRAVO_TABLE_SIZE; ++i)
+        {
+            rsm_backoff backoff;
+            while (rsm_bravo_visible_readers[i].load(std::memory_order_acquire) == this)
+            {
+                if (!wait)
+                {
+                    drained = false;
+                    break;
+                }
+                backoff.pause();
+            }
+        }
+        const int64_t end_ns = rsm_steady_now_ns();
+        _inhibit_until_ns.store(end_ns + (end_ns - start_ns) * RSM_BRAVO_INHIBIT_MULTIPLIER, std::memory_order_relaxed);
+        return drained;
+    }
+
+    // must be called by the exclusive owner
+    void end_ownership_if_done()
+    {
+        if (_owner_write_locks == 0 && (_owner_promoted || _owner_shared_locks == 0))
+        {
+            _owner.store(NON_THREAD_ID, std::memory_order_relaxed);
+        }
+    }
+
+public:
+    rsm_bravo()
+        : _read_bias(true), _inhibit_until_ns(0), _owner(NON_THREAD_ID), _owner_write_locks(0), _owner_shared_locks(0),
+          _owner_promoted(false)
+    {
+    }
+    rsm_bravo(const rsm_bravo &) = delete;
+    rsm_bravo &operator=(const rsm_bravo &) = delete;
+
+    /**
+     * Get exclusive ownership of the mutex, then revoke the read bias and wait for the readers
+     * published in the visible readers table to leave.
+     */
+    void lock()
+    {
+        _mutex.lock();
+        take_ownership(false);
+        revoke_bias(true);
+    }
+
+    /**
+     * Like lock() but never blocks, fails if published readers are still in their read sections.
+     * The lock stays read biased in that case.
+     */
+    bool try_lock()
+    {
+        if (!_mutex.try_lock())
+        {
+            return false;
+        }
+        take_ownership(false);
+        if (!revoke_bias(false))
+        {
+            // the readers we found are still published, the next writer has to wait for them so the
+            // bias has to be revoked again
+            _read_bias.store(true);
+            unlock();
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * See try_promotion() of the mutex. A read section held through the visible readers table is
+     * first turned into shared ownership of the mutex, which fails if a writer is in or waiting.
+     *
+     * @return false if the read section could not be turned into shared ownership or the mutex
+     * refused the promotion, the thread keeps its shared ownership either way
+     */
+    bool try_promotion()
+    {
+        uint64_t *our_count = rsm_bravo_read_counts.find(this);
+        if (our_count != nullptr)
+        {
+            if (!_mutex.try_lock_shared())
+            {
+                return false;
+            }
+            // recursive shared locks of a shared owner never block
+            for (uint64_t i = 1; i < *our_count; ++i)
+            {
+                _mutex.lock_shared();
+            }
+            rsm_bravo_read_counts.erase(this);
+            slot_for_this_thread().store(nullptr, std::memory_order_release);
+        }
+        if (!_mutex.try_promotion())
+        {
+            return false;
+        }
+        take_ownership(true);
+        revoke_bias(true);
+        return true;
+    }
+
+    void unlock()
+    {
+        if (is_owner())
+        {
+            _owner_write_locks--;
+            end_ownership_if_done();
+        }
+        _mutex.unlock();
+    }
+
+    /**
+     * Get shared ownership through the visible readers table if the lock is read biased, otherwise
+     * from the mutex. Never blocks when the calling thread already has shared ownership.
+     */
+    void lock_shared()
+    {
+        if (is_owner())
+        {
+            _owner_shared_locks++;
+            _mutex.lock_shared();
+            return;
+        }
+        if (try_lock_shared_biased())
+        {
+            return;
+        }
+        _mutex.lock_shared();
+        maybe_restore_bias();
+    }
+
+    bool try_lock_shared()
+    {
+        if (is_owner())
+        {
+            // the exclusive owner can always lock shared
+            _mutex.lock_shared();
+            _owner_shared_locks++;
+            return true;
+        }
+        if (try_lock_shared_biased())
+        {
+            return true;
+        }
+        if (!_mutex.try_lock_shared())
+        {
+            return false;
+        }
+        maybe_restore_bias();
+        return true;
+    }
+
+    void unlock_shared()
+    {
+        if (is_owner() && _owner_shared_locks != 0)
+        {
+            _owner_shared_locks--;
+            end_ownership_if_done();
+            _mutex.unlock_shared();
+            return;
+        }
+        uint64_t *our_count = rsm_bravo_read_counts.find(this);
+        if (our_count == nullptr)
+        {
+            _mutex.unlock_shared();
+            return;
+        }
+        *our_count = *our_count - 1;
+        if (*our_count == 0)
+        {
+            rsm_bravo_read_counts.erase(this);
+            slot_for_this_thread().store(nullptr, std::memory_order_release);
+        }
+    }
+
+    /**
+     * @return true while readers can publish themselves in the visible readers table
+     */
+    bool read_biased() const { return _read_bias.load(std::memory_order_relaxed); }
+};
+
+#endif // _RSM_BRAVO_H
@@ -0,0 +1,111 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef _RSM_COMPACT_H
+#define _RSM_COMPACT_H
+
+#include "rsm_owner_table.h"
+
+#include <atomic>
+#include <cstdint>
+
+// the shared locks each thread holds on each rsm_compact_mutex it counts as a shared owner of
+extern thread_local rsm_owner_table<RSM_OWNER_TABLE_CAPACITY> rsm_compact_shared_counts;
+// for each rsm_compact_mutex this thread has exclusive ownership of, the number of exclusive locks in
+// the low 32 bits and the number of shared locks taken while having it in the high 32 bits
+extern thread_local rsm_owner_table<RSM_OWNER_TABLE_CAPACITY> rsm_compact_exclusive_counts;
+
+/**
+ * A recursive shared mutex that is a single 64 bit word, for when there is one per object and there are
+ * millions of objects.
+ *
+ * Everything recursive_shared_mutex keeps per instance apart from the state word is kept elsewhere:
+ * - recursion and promotion are tracked per thread in thread local tables keyed by the mutex address,
+ * so a thread finds out what it holds without touching the mutex
+ * - threads that have to wait park in the global parking lot (rsm_parking_lot.h) keyed by the mutex
+ * address instead of on condition variables of their own
+ *
+ * The trade offs against recursive_shared_mutex: there is no FIFO queue, a thread calling lock() can get
+ * in ahead of a parked writer that was just woken. A waiting writer blocks new readers and the readers
+ * parked while a writer had exclusive ownership all go before the next writer, so neither side starves.
+ * Only one thread can wait for promotion at a time, try_promotion() returns false while another thread
+ * does. There are no timed waits.
+ */
+class rsm_compact_mutex
+{
+private:
+    std::atomic<uint64_t> _state;
+
+    // threads with shared ownership, the promoted thread stays counted while it has exclusive ownership
+    static constexpr uint64_t READER_MASK = (uint64_t(1) << 48) - 1;
+    static constexpr uint64_t WRITER_HELD = uint64_t(1) << 63;
+    // writers are parked on this mutex, new readers park behind them
+    static constexpr uint64_t WRITERS_PARKED = uint64_t(1) << 62;
+    // a shared owner is waiting for the other shared owners to leave, blocks new readers and writers
+    static constexpr uint64_t PROMOTION_PENDING = uint64_t(1) << 61;
+    // readers are parked on this mutex, they are admitted all at once when exclusive ownership ends
+    static constexpr uint64_t READERS_PARKED = uint64_t(1) << 60;
+
+    // what a thread parked on this mutex waits for
+    static constexpr uint32_t PARK_WRITER = 1;
+    static constexpr uint32_t PARK_READER = 2;
+    static constexpr uint32_t PARK_PROMOTION = 4;
+
+    bool try_lock_exclusive();
+    void lock_exclusive();
+    bool try_lock_shared_fast();
+    void release_exclusive_ownership();
+    void release_shared_ownership();
+    // wake whoever can go next, with writer_released the readers that parked while a writer had exclusive
+    // ownership go before any parked writer
+    void unpark_waiters(const bool &writer_released);
+
+public:
+    rsm_compact_mutex() : _state(0) {}
+    rsm_compact_mutex(const rsm_compact_mutex &) = delete;
+    rsm_compact_mutex &operator=(const rsm_compact_mutex &) = delete;
+
+    /**
+     * Get exclusive ownership, parking in the parking lot while other threads have ownership.
+     * Recursive calls by the exclusive owner do not block.
+     *
+     * @param none
+     * @return none
+     */
+    void lock();
+
+    /**
+     * Like lock() but never parks.
+     *
+     * @return false if another thread has ownership or is waiting for promotion
+     */
+    bool try_lock();
+
+    void unlock();
+
+    /**
+     * Turn shared ownership into exclusive ownership, waiting for the other shared owners to leave.
+     * New readers and writers are blocked until then. unlock() goes back to shared ownership.
+     *
+     * @param none
+     * @return false if another thread is already waiting for promotion or has exclusive ownership
+     */
+    bool try_promotion();
+
+    /**
+     * Get shared ownership, parking while a thread has exclusive ownership or waits for it.
+     * Recursive calls and calls by the exclusive owner do not block.
+     *
+     * @param none
+     * @return none
+     */
+    void lock_shared();
+
+    bool try_lock_shared();
+
+    void unlock_shared();
+};
+
+#endif // _RSM_COMPACT_H
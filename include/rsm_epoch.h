@@ -0,0 +1,177 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef _RSM_EPOCH_H
+#define _RSM_EPOCH_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "rsm_padded.h"
+
+// once this many objects are waiting to be reclaimed the background thread is woken, without a background
+// thread retire() reclaims them itself
+#ifndef RSM_EPOCH_RECLAIM_BATCH
+#define RSM_EPOCH_RECLAIM_BATCH 64
+#endif
+
+// the background thread also reclaims whatever is left this often, in milliseconds
+#ifndef RSM_EPOCH_RECLAIM_INTERVAL_MS
+#define RSM_EPOCH_RECLAIM_INTERVAL_MS 10
+#endif
+
+// the epoch a thread published when it entered its outermost read section, 0 while it is not in one.
+// on a cache line of its own so that threads entering and leaving read sections do not share cache lines
+struct alignas(RSM_CACHE_LINE_SIZE) rsm_epoch_record
+{
+    std::atomic<uint64_t> epoch;
+    // claimed by a thread for as long as it lives, free records are reused by new threads
+    std::atomic<bool> in_use;
+    // read sections the owning thread has entered, only touched by that thread
+    uint64_t nesting;
+
+    rsm_epoch_record() : epoch(0), in_use(true), nesting(0) {}
+};
+
+/**
+ * Epoch based deferred reclamation to use together with recursive_shared_mutex.
+ *
+ * Readers that walk pointer linked structures enter a read section with lock_shared() instead of
+ * taking shared ownership of the mutex. Writers still serialize on the mutex, unlink what they replace
+ * and hand it to retire() instead of freeing it. The object is freed once every reader that could
+ * still see it has left its read section, so a writer never waits for readers and never frees
+ * memory while it has exclusive ownership.
+ *
+ * Entering and leaving a read section only writes to a cache line owned by the calling thread.
+ * Read sections can be nested. Retired objects are freed in batches by a background thread, or by
+ * the thread calling retire() if the domain was created without one.
+ *
+ * lock_shared() and unlock_shared() let std::shared_lock manage read sections.
+ */
+class rsm_epoch_domain
+{
+private:
+    struct retired_object
+    {
+        void *ptr;
+        void (*deleter)(void *);
+        // the epoch the object was retired in, readers that published a later epoch can not see it
+        uint64_t epoch;
+    };
+
+    // unique for the life of the process so a thread never mistakes a new domain for one that was
+    // destroyed at the same address
+    const uint64_t _id;
+    // advanced by every retire()
+    std::atomic<uint64_t> _epoch;
+
+    // protects everything below
+    std::mutex _mutex;
+    // the records of every thread that ever entered a read section of this domain, threads that exited
+    // keep their record alive until they release it so the domain and the thread can go in any order
+    std::vector<std::shared_ptr<rsm_epoch_record> > _records;
+    std::vector<retired_object> _retired;
+
+    const bool _background;
+    std::thread _reclaimer;
+    std::condition_variable _reclaimer_gate;
+    bool _stopping;
+
+    rsm_epoch_record *record_for_this_thread();
+    rsm_epoch_record *register_this_thread();
+    // @return the oldest epoch published by a thread in a read section, UINT64_MAX if there is none
+    uint64_t oldest_active_epoch();
+    void free_retired(std::vector<retired_object> &objects);
+    void reclaimer_loop();
+
+public:
+    /**
+     * @param background_reclaim free retired objects on a background thread that is started by the first
+     * retire(). Without it retire() frees a batch itself once RSM_EPOCH_RECLAIM_BATCH objects are waiting.
+     */
+    explicit rsm_epoch_domain(bool background_reclaim = true);
+
+    /**
+     * Frees every object that is still waiting. No thread may be in a read section or call retire().
+     */
+    ~rsm_epoch_domain();
+    rsm_epoch_domain(const rsm_epoch_domain &) = delete;
+    rsm_epoch_domain &operator=(const rsm_epoch_domain &) = delete;
+
+    /**
+     * Enter a read section.
+     *
+     * This call never blocks.
+     * Objects retired after this call are not freed until the thread leaves its outermost read section.
+     * The first call of a thread registers it with the domain, after that it only writes to the
+     * thread's own record.
+     *
+     *
+     * @param none
+     * @return none
+     */
+    void lock_shared();
+
+    /**
+     * Leave a read section, must be called once for each lock_shared().
+     *
+     * @param none
+     * @return none
+     */
+    void unlock_shared();
+
+    /**
+     * Free ptr with deleter once no reader can see it anymore.
+     *
+     * This call never blocks on readers and never frees anything it was just given, it is meant to be
+     * called by a writer while it has exclusive ownership, right after unlinking ptr. A capture free
+     * lambda works as deleter.
+     *
+     *
+     * @param ptr an object that has already been unlinked, new readers must not be able to find it
+     * @param deleter called with ptr to free it
+     * @return none
+     */
+    void retire(void *ptr, void (*deleter)(void *));
+
+    template <class T>
+    void retire(T *ptr)
+    {
+        retire(static_cast<void *>(ptr), [](void *object) { delete static_cast<T *>(object); });
+    }
+
+    /**
+     * Free every retired object that no reader can see anymore.
+     *
+     * This call never blocks on readers. The deleters run without any lock held.
+     *
+     *
+     * @param none
+     * @return the number of objects freed
+     */
+    size_t reclaim();
+
+    /**
+     * Wait until every reader that was in a read section when this was called has left it, then
+     * reclaim(). Must not be called from inside a read section.
+     *
+     * @param none
+     * @return none
+     */
+    void synchronize();
+
+    /**
+     * @return the number of retired objects that have not been freed yet
+     */
+    size_t pending();
+};
+
+#endif // _RSM_EPOCH_H
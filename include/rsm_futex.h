@@ -0,0 +1,135 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef _RSM_FUTEX_H
+#define _RSM_FUTEX_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+/**
+ * Linux futex based replacements for std::mutex and std::condition_variable, selected with
+ * --enable-futex. They are only meant to be used together, as the internal mutex and gates of
+ * recursive_shared_mutex.
+ *
+ * The waiters of rsm_futex_condition sleep on a sequence word inside the condition. notify_all()
+ * wakes one waiter and requeues the rest onto the mutex word with FUTEX_CMP_REQUEUE, so they are
+ * woken one at a time as the mutex is released instead of all of them racing for the mutex.
+ */
+
+class rsm_futex_mutex
+{
+    friend class rsm_futex_condition;
+
+private:
+    // 0 unlocked, 1 locked, 2 locked and there might be threads sleeping on _word
+    std::atomic<uint32_t> _word;
+
+    void lock_contended();
+    void wake_one();
+
+public:
+    rsm_futex_mutex() : _word(0) {}
+    rsm_futex_mutex(const rsm_futex_mutex &) = delete;
+    rsm_futex_mutex &operator=(const rsm_futex_mutex &) = delete;
+
+    void lock()
+    {
+        uint32_t expected = 0;
+        if (!_word.compare_exchange_strong(expected, 1, std::memory_order_acquire, std::memory_order_relaxed))
+        {
+            lock_contended();
+        }
+    }
+
+    bool try_lock()
+    {
+        uint32_t expected = 0;
+        return _word.compare_exchange_strong(expected, 1, std::memory_order_acquire, std::memory_order_relaxed);
+    }
+
+    void unlock()
+    {
+        if (_word.exchange(0, std::memory_order_release) == 2)
+        {
+            wake_one();
+        }
+    }
+};
+
+class rsm_futex_condition
+{
+private:
+    // incremented by every notify, waiters sleep until it changes
+    std::atomic<uint32_t> _sequence;
+    // number of threads waiting, only changed with the mutex locked so notifies can skip the syscall
+    uint32_t _waiters;
+    // the mutex the waiters hold, notify_all() requeues waiters onto it
+    rsm_futex_mutex *_mutex;
+
+public:
+    rsm_futex_condition() : _sequence(0), _waiters(0), _mutex(nullptr) {}
+    rsm_futex_condition(const rsm_futex_condition &) = delete;
+    rsm_futex_condition &operator=(const rsm_futex_condition &) = delete;
+
+    /**
+     * Release the mutex and sleep until notified, the mutex is locked again before returning.
+     * Like std::condition_variable this can return spuriously.
+     *
+     * @param lock must own the mutex that is held by every thread notifying this condition
+     * @return none
+     */
+    void wait(std::unique_lock<rsm_futex_mutex> &lock);
+
+    template <class Predicate>
+    void wait(std::unique_lock<rsm_futex_mutex> &lock, Predicate pred)
+    {
+        while (!pred())
+        {
+            wait(lock);
+        }
+    }
+
+    /**
+     * Like wait() but gives up at deadline
+     *
+     * @param lock must own the mutex that is held by every thread notifying this condition
+     * @param deadline steady clock time at which to stop waiting
+     * @return std::cv_status::timeout if deadline passed, otherwise std::cv_status::no_timeout
+     */
+    std::cv_status wait_until(std::unique_lock<rsm_futex_mutex> &lock,
+        const std::chrono::steady_clock::time_point &deadline);
+
+    template <class Predicate>
+    bool wait_until(std::unique_lock<rsm_futex_mutex> &lock,
+        const std::chrono::steady_clock::time_point &deadline,
+        Predicate pred)
+    {
+        while (!pred())
+        {
+            if (wait_until(lock, deadline) == std::cv_status::timeout)
+            {
+                return pred();
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Wake one waiting thread. Must be called with the mutex locked.
+     */
+    void notify_one();
+
+    /**
+     * Wake all waiting threads. Must be called with the mutex locked, one waiter is woken and the
+     * others are moved to the mutex word so they take turns acquiring the mutex.
+     */
+    void notify_all();
+};
+
+#endif // _RSM_FUTEX_H
@@ -0,0 +1,199 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef _RSM_GUARDED_H
+#define _RSM_GUARDED_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <utility>
+
+#include "recursive_shared_mutex.h"
+
+/**
+ * A T that can only be reached with the right ownership of its mutex. read(fn) calls fn with a const T&
+ * under shared ownership, write(fn) with a T& under exclusive ownership, and ownership always ends when
+ * fn returns or throws, so there is no unlock to forget and nothing is held longer than fn runs.
+ *
+ * snapshot() returns an immutable copy of T that is only made again after a write, a hot reader can keep
+ * using the copy it holds without touching the mutex at all. Any Mutex with lock(), lock_shared() and
+ * try_promotion() works, read_then_promote() falls back to lock() when a promotion is refused.
+ */
+template <class T, class Mutex = recursive_shared_mutex>
+class rsm_guarded
+{
+private:
+    // a copy of the value and the write count it was copied at, snapshot() hands out the value part
+    struct snapshot_entry
+    {
+        uint64_t writes;
+        T value;
+
+        snapshot_entry(const uint64_t &count, const T &initial) : writes(count), value(initial) {}
+    };
+
+    mutable Mutex _mutex;
+    T _value;
+    // the number of writes that have finished, only changes with exclusive ownership
+    std::atomic<uint64_t> _writes;
+    // only read and replaced with std::atomic_load() and std::atomic_store()
+    mutable std::shared_ptr<const snapshot_entry> _snapshot;
+
+    // counts a write when it ends, before exclusive ownership is released, even if fn threw
+    struct write_scope
+    {
+        std::atomic<uint64_t> &writes;
+        explicit write_scope(std::atomic<uint64_t> &counter) : writes(counter) {}
+        ~write_scope() { writes.fetch_add(1, std::memory_order_release); }
+    };
+
+public:
+    /**
+     * What read_then_promote() passes to fn. It starts out with shared ownership, promote() turns that
+     * into exclusive ownership. Whatever ownership it has ends when read_then_promote() returns.
+     */
+    class promotable
+    {
+    private:
+        rsm_guarded &_guarded;
+        uint64_t _writes_seen;
+        bool _exclusive;
+        bool _shared;
+
+        friend class rsm_guarded;
+
+        explicit promotable(rsm_guarded &guarded)
+            : _guarded(guarded), _writes_seen(0), _exclusive(false), _shared(false)
+        {
+            _guarded._mutex.lock_shared();
+            _shared = true;
+            _writes_seen = _guarded._writes.load(std::memory_order_acquire);
+        }
+
+    public:
+        ~promotable()
+        {
+            if (_exclusive)
+            {
+                _guarded._writes.fetch_add(1, std::memory_order_release);
+                _guarded._mutex.unlock();
+            }
+            if (_shared)
+            {
+                _guarded._mutex.unlock_shared();
+            }
+        }
+
+        promotable(const promotable &) = delete;
+        promotable &operator=(const promotable &) = delete;
+
+        const T &get() const { return _guarded._value; }
+
+        /**
+         * Get exclusive ownership, see try_promotion() of the mutex. If the mutex refuses the promotion shared
+         * ownership is given up and the thread waits in lock() instead. Another writer may have run before
+         * exclusive ownership was obtained either way, check changed() and look at the value again if it did.
+         *
+         * @return the value, writable until read_then_promote() returns
+         */
+        T &promote()
+        {
+            if (!_exclusive)
+            {
+                if (!_guarded._mutex.try_promotion())
+                {
+                    _guarded._mutex.unlock_shared();
+                    _shared = false;
+                    _guarded._mutex.lock();
+                }
+                _exclusive = true;
+            }
+            return _guarded._value;
+        }
+
+        // true if another thread wrote the value since fn was called
+        bool changed() const { return _guarded._writes.load(std::memory_order_acquire) != _writes_seen; }
+        bool promoted() const { return _exclusive; }
+    };
+
+    template <class... Args>
+    explicit rsm_guarded(Args &&... args) : _value(std::forward<Args>(args)...), _writes(0)
+    {
+    }
+
+    rsm_guarded(const rsm_guarded &) = delete;
+    rsm_guarded &operator=(const rsm_guarded &) = delete;
+
+    /**
+     * Call fn with the value under shared ownership.
+     *
+     * @param fn callable with a const T&
+     * @return what fn returned
+     */
+    template <class Function>
+    auto read(Function fn) const -> decltype(fn(std::declval<const T &>()))
+    {
+        std::shared_lock<Mutex> _lock(_mutex);
+        return fn(static_cast<const T &>(_value));
+    }
+
+    /**
+     * Call fn with the value under exclusive ownership. The next snapshot() makes a new copy.
+     *
+     * @param fn callable with a T&
+     * @return what fn returned
+     */
+    template <class Function>
+    auto write(Function fn) -> decltype(fn(std::declval<T &>()))
+    {
+        std::lock_guard<Mutex> _lock(_mutex);
+        write_scope scope(_writes);
+        return fn(_value);
+    }
+
+    /**
+     * Call fn with a promotable under shared ownership. fn reads the value with get() and only calls
+     * promote() when it decides to write, so a check that usually ends without a write never blocks
+     * other readers. The value has to be checked again after promote() when changed() returns true.
+     *
+     * @param fn callable with a promotable&
+     * @return what fn returned
+     */
+    template <class Function>
+    auto read_then_promote(Function fn) -> decltype(fn(std::declval<promotable &>()))
+    {
+        promotable handle(*this);
+        return fn(handle);
+    }
+
+    /**
+     * An immutable copy of the value. The copy is shared by every caller until the next write ends, only
+     * then does the next call take shared ownership to make a new one. A write in progress is not seen,
+     * the copy from before it is returned without waiting for the writer.
+     *
+     * @return the latest copy, it stays valid and unchanged for as long as the caller holds it
+     */
+    std::shared_ptr<const T> snapshot() const
+    {
+        std::shared_ptr<const snapshot_entry> entry = std::atomic_load(&_snapshot);
+        if (entry == nullptr || entry->writes != _writes.load(std::memory_order_acquire))
+        {
+            std::shared_lock<Mutex> _lock(_mutex);
+            entry = std::make_shared<const snapshot_entry>(_writes.load(std::memory_order_acquire), _value);
+            _lock.unlock();
+            // a racing refresh may store an older copy, that only means the next call copies again
+            std::atomic_store(&_snapshot, entry);
+        }
+        return std::shared_ptr<const T>(entry, &entry->value);
+    }
+
+    // the number of writes that have finished, write() and promotions by read_then_promote() each count once
+    uint64_t writes() const { return _writes.load(std::memory_order_acquire); }
+};
+
+#endif // _RSM_GUARDED_H
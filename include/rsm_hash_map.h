@@ -0,0 +1,299 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef _RSM_HASH_MAP_H
+#define _RSM_HASH_MAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <utility>
+#include <vector>
+
+#include "recursive_shared_mutex.h"
+#include "rsm_padded.h"
+#include "rsm_striped.h"
+
+// the default number of stripes of rsm_hash_map, more stripes let more writers in at once
+#ifndef RSM_HASH_MAP_STRIPES
+#define RSM_HASH_MAP_STRIPES 64
+#endif
+
+// the number of buckets every stripe of rsm_hash_map starts with, a power of 2
+#ifndef RSM_HASH_MAP_INITIAL_BUCKETS
+#define RSM_HASH_MAP_INITIAL_BUCKETS 8
+#endif
+
+/**
+ * A concurrent hash map for read mostly caches. The keys are split over the stripes of an rsm_striped
+ * table and every stripe has its own buckets, guarded by the mutex of that stripe.
+ *
+ * Lookups take shared ownership of one stripe. find_or_insert() looks the key up with shared ownership
+ * and only when it is missing promotes to exclusive ownership of that stripe with try_promotion(), so a
+ * miss does not have to let go of the stripe and look again from scratch. A stripe doubles its buckets
+ * on its own when it holds more entries than buckets, so a resize only holds one stripe exclusively and
+ * the table grows one stripe at a time. Values are copied out, no reference into the map outlives the
+ * lock it was read under.
+ */
+template <class Key, class Value, class Hash = std::hash<Key>, class Mutex = recursive_shared_mutex>
+class rsm_hash_map
+{
+private:
+    typedef std::vector<std::pair<Key, Value> > bucket;
+
+    struct segment
+    {
+        std::vector<bucket> buckets;
+        size_t size;
+
+        segment() : buckets(RSM_HASH_MAP_INITIAL_BUCKETS), size(0) {}
+    };
+
+    mutable rsm_striped<0, Mutex> _striped;
+    rsm_padded_array<segment> _segments;
+
+    static uint64_t hash_of(const Key &key) { return rsm_striped<0, Mutex>::template mixed_hash<Key, Hash>(key); }
+
+    // the stripe takes the low part of the mixed hash modulo the stripe count, the bucket the rest
+    size_t bucket_index(const segment &seg, const uint64_t &mixed) const
+    {
+        return (mixed / _striped.stripes()) & (seg.buckets.size() - 1);
+    }
+
+    bucket &bucket_of(segment &seg, const uint64_t &mixed) const { return seg.buckets[bucket_index(seg, mixed)]; }
+
+    template <class Bucket>
+    static auto find_in(Bucket &entries, const Key &key) -> decltype(&entries.front())
+    {
+        for (auto &entry : entries)
+        {
+            if (entry.first == key)
+            {
+                return &entry;
+            }
+        }
+        return nullptr;
+    }
+
+    // called with exclusive ownership of the stripe of seg
+    void insert_new(segment &seg, const uint64_t &mixed, const Key &key, const Value &value)
+    {
+        bucket_of(seg, mixed).emplace_back(key, value);
+        seg.size++;
+        if (seg.size > seg.buckets.size())
+        {
+            grow(seg);
+        }
+    }
+
+    // called with exclusive ownership of the stripe of seg, another thread may have inserted key first
+    Value insert_if_missing(segment &seg, const uint64_t &mixed, const Key &key, const Value &value)
+    {
+        const std::pair<Key, Value> *entry = find_in(bucket_of(seg, mixed), key);
+        if (entry != nullptr)
+        {
+            return entry->second;
+        }
+        insert_new(seg, mixed, key, value);
+        return value;
+    }
+
+    // ends the exclusive ownership a promotion added on top of shared ownership, the shared one stays
+    struct promotion_scope
+    {
+        Mutex &mutex;
+        explicit promotion_scope(Mutex &stripe) : mutex(stripe) {}
+        ~promotion_scope() { mutex.unlock(); }
+    };
+
+    // ends the exclusive ownership of every stripe that lock_all_stripes() took
+    struct all_stripes_scope
+    {
+        rsm_striped<0, Mutex> &striped;
+        explicit all_stripes_scope(rsm_striped<0, Mutex> &table) : striped(table) {}
+        ~all_stripes_scope() { striped.unlock_all_stripes(); }
+    };
+
+    // double the buckets of one stripe, called with exclusive ownership of that stripe
+    void grow(segment &seg)
+    {
+        std::vector<bucket> old_buckets(seg.buckets.size() * 2);
+        // seg gets the new empty buckets, the entries are moved over from the old ones
+        old_buckets.swap(seg.buckets);
+        for (auto &entries : old_buckets)
+        {
+            for (auto &entry : entries)
+            {
+                bucket_of(seg, hash_of(entry.first)).push_back(std::move(entry));
+            }
+        }
+    }
+
+public:
+    /**
+     * @param stripes the number of stripes, the most writers that can hold the map at the same time
+     */
+    explicit rsm_hash_map(const size_t &stripes = RSM_HASH_MAP_STRIPES) : _striped(stripes), _segments(stripes) {}
+
+    rsm_hash_map(const rsm_hash_map &) = delete;
+    rsm_hash_map &operator=(const rsm_hash_map &) = delete;
+
+    size_t stripes() const { return _striped.stripes(); }
+
+    /**
+     * Copy the value of key into value.
+     *
+     * This call is blocking while another thread writes to the stripe of key.
+     *
+     *
+     * @return false if key is not in the map, value is left alone then
+     */
+    bool find(const Key &key, Value &value) const
+    {
+        const uint64_t mixed = hash_of(key);
+        const size_t index = _striped.stripe_of_hash(mixed);
+        std::shared_lock<Mutex> _lock(_striped.stripe(index));
+        const segment &seg = _segments[index];
+        const std::pair<Key, Value> *entry = find_in(seg.buckets[bucket_index(seg, mixed)], key);
+        if (entry == nullptr)
+        {
+            return false;
+        }
+        value = entry->second;
+        return true;
+    }
+
+    bool contains(const Key &key) const
+    {
+        Value value;
+        return find(key, value);
+    }
+
+    /**
+     * Return the value of key, inserting value first if key is not in the map.
+     *
+     * A hit only takes shared ownership of the stripe of key. A miss promotes it to exclusive ownership
+     * and looks again, another candidate that was promoted first may have inserted key in between.
+     *
+     *
+     * @return the value of key in the map, value if it was inserted
+     */
+    Value find_or_insert(const Key &key, const Value &value)
+    {
+        const uint64_t mixed = hash_of(key);
+        const size_t index = _striped.stripe_of_hash(mixed);
+        Mutex &mutex = _striped.stripe(index);
+        segment &seg = _segments[index];
+        std::shared_lock<Mutex> _shared_lock(mutex);
+        const std::pair<Key, Value> *entry = find_in(bucket_of(seg, mixed), key);
+        if (entry != nullptr)
+        {
+            return entry->second;
+        }
+        if (mutex.try_promotion())
+        {
+            // released before _shared_lock, the promotion is undone first
+            promotion_scope promoted(mutex);
+            return insert_if_missing(seg, mixed, key, value);
+        }
+        // rsm_compact_mutex refuses a second pending promotion, look again with exclusive ownership then
+        _shared_lock.unlock();
+        std::lock_guard<Mutex> _lock(mutex);
+        return insert_if_missing(seg, mixed, key, value);
+    }
+
+    /**
+     * Set the value of key, inserting it if it is not in the map.
+     *
+     * @return true if key was inserted, false if an existing value was replaced
+     */
+    bool insert_or_assign(const Key &key, const Value &value)
+    {
+        const uint64_t mixed = hash_of(key);
+        const size_t index = _striped.stripe_of_hash(mixed);
+        segment &seg = _segments[index];
+        std::lock_guard<Mutex> _lock(_striped.stripe(index));
+        std::pair<Key, Value> *entry = find_in(bucket_of(seg, mixed), key);
+        if (entry != nullptr)
+        {
+            entry->second = value;
+            return false;
+        }
+        insert_new(seg, mixed, key, value);
+        return true;
+    }
+
+    /**
+     * Remove key from the map. Buckets are never shrunk.
+     *
+     * @return false if key was not in the map
+     */
+    bool erase(const Key &key)
+    {
+        const uint64_t mixed = hash_of(key);
+        const size_t index = _striped.stripe_of_hash(mixed);
+        segment &seg = _segments[index];
+        std::lock_guard<Mutex> _lock(_striped.stripe(index));
+        bucket &entries = bucket_of(seg, mixed);
+        std::pair<Key, Value> *entry = find_in(entries, key);
+        if (entry != nullptr)
+        {
+            // order within a bucket does not matter, fill the hole with the last entry
+            if (entry != &entries.back())
+            {
+                *entry = std::move(entries.back());
+            }
+            entries.pop_back();
+            seg.size--;
+        }
+        return entry != nullptr;
+    }
+
+    /**
+     * The number of entries. Every stripe is counted under its own shared ownership, so while other
+     * threads write this is not the size the map had at any one moment.
+     */
+    size_t size() const
+    {
+        size_t total = 0;
+        for (size_t i = 0; i < _striped.stripes(); ++i)
+        {
+            std::shared_lock<Mutex> _lock(_striped.stripe(i));
+            total += _segments[i].size;
+        }
+        return total;
+    }
+
+    /**
+     * The number of buckets of all stripes together.
+     */
+    size_t bucket_count() const
+    {
+        size_t total = 0;
+        for (size_t i = 0; i < _striped.stripes(); ++i)
+        {
+            std::shared_lock<Mutex> _lock(_striped.stripe(i));
+            total += _segments[i].buckets.size();
+        }
+        return total;
+    }
+
+    /**
+     * Remove every entry, with exclusive ownership of every stripe at once.
+     */
+    void clear()
+    {
+        _striped.lock_all_stripes();
+        all_stripes_scope scope(_striped);
+        for (size_t i = 0; i < _striped.stripes(); ++i)
+        {
+            _segments[i] = segment();
+        }
+    }
+};
+
+#endif // _RSM_HASH_MAP_H
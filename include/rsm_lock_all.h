@@ -0,0 +1,204 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef _RSM_LOCK_ALL_H
+#define _RSM_LOCK_ALL_H
+
+#include <cstddef>
+#include <thread>
+
+enum class rsm_lock_mode
+{
+    shared,
+    exclusive
+};
+
+/**
+ * One mutex and the ownership rsm_lock_all() should take of it. Build them with rsm_shared() and
+ * rsm_exclusive().
+ */
+template <class Mutex>
+struct rsm_lock_request
+{
+    Mutex *mutex;
+    rsm_lock_mode mode;
+};
+
+template <class Mutex>
+rsm_lock_request<Mutex> rsm_shared(Mutex &mutex)
+{
+    return {&mutex, rsm_lock_mode::shared};
+}
+
+template <class Mutex>
+rsm_lock_request<Mutex> rsm_exclusive(Mutex &mutex)
+{
+    return {&mutex, rsm_lock_mode::exclusive};
+}
+
+/**
+ * Take the ownership request asks for. A thread with shared ownership can not get exclusive ownership
+ * with lock(), it would wait for itself to leave, so it is promoted instead. Without blocking that is
+ * try_promotion_no_wait(), which never queues the thread ahead of anyone or turns new readers away.
+ *
+ * @param blocking wait for ownership or only try once
+ * @return false if ownership was not obtained. A blocking call only fails when the promotion was refused
+ * because another thread has update ownership
+ */
+template <class Mutex>
+bool rsm_acquire_request(const rsm_lock_request<Mutex> &request, const bool &blocking)
+{
+    Mutex &mutex = *request.mutex;
+    if (request.mode == rsm_lock_mode::shared)
+    {
+        if (!blocking)
+        {
+            return mutex.try_lock_shared();
+        }
+        mutex.lock_shared();
+        return true;
+    }
+    if (mutex.has_shared_ownership())
+    {
+        return blocking ? mutex.try_promotion() : mutex.try_promotion_no_wait();
+    }
+    if (!blocking)
+    {
+        return mutex.try_lock();
+    }
+    mutex.lock();
+    return true;
+}
+
+template <class Mutex>
+void rsm_release_request(const rsm_lock_request<Mutex> &request)
+{
+    if (request.mode == rsm_lock_mode::shared)
+    {
+        request.mutex->unlock_shared();
+    }
+    else
+    {
+        request.mutex->unlock();
+    }
+}
+
+/**
+ * Take every requested ownership without deadlocking against other threads doing the same with the
+ * mutexes in a different order, the way std::lock does for exclusive ownership only.
+ *
+ * The thread blocks on one request and only tries the others. If one of them is busy it releases what
+ * it got, yields and then blocks on the busy one first, so it never waits while holding ownership it
+ * took here and two threads can not keep knocking each other back.
+ * Mutexes the thread already has ownership of recurse and are never waited on, except for an exclusive
+ * request on a mutex it only has shared ownership of which is a promotion, see try_promotion(). A mutex
+ * may be requested more than once, shared and exclusive requests for the same mutex end with exclusive
+ * ownership. Ownership the thread had before the call is kept while it backs off, so it can still
+ * deadlock against a thread waiting for that. Needs recursion and the promotion policy.
+ *
+ *
+ * @param requests the mutexes and the ownership to take of each, all of the same Mutex type
+ * @return false if a promotion was refused because another thread has update ownership, nothing was
+ * taken then. true when every request has been granted, release them with rsm_unlock_all()
+ */
+template <class Mutex>
+bool rsm_lock_all(const rsm_lock_request<Mutex> *requests, const size_t &count)
+{
+    size_t first = 0;
+    while (count != 0)
+    {
+        if (!rsm_acquire_request(requests[first], true))
+        {
+            return false;
+        }
+        size_t taken = 1;
+        while (taken < count && rsm_acquire_request(requests[(first + taken) % count], false))
+        {
+            taken++;
+        }
+        if (taken == count)
+        {
+            break;
+        }
+        // newest first, a promotion has to end before the shared ownership it was promoted from
+        for (size_t i = taken; i > 0; --i)
+        {
+            rsm_release_request(requests[(first + i - 1) % count]);
+        }
+        first = (first + taken) % count;
+        std::this_thread::yield();
+    }
+    return true;
+}
+
+/**
+ * Take every requested ownership like rsm_lock_all() but never block.
+ *
+ * @return false if any request could not be granted right away, none of them are held then
+ */
+template <class Mutex>
+bool rsm_try_lock_all(const rsm_lock_request<Mutex> *requests, const size_t &count)
+{
+    for (size_t taken = 0; taken < count; ++taken)
+    {
+        if (!rsm_acquire_request(requests[taken], false))
+        {
+            while (taken > 0)
+            {
+                --taken;
+                rsm_release_request(requests[taken]);
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Release every ownership granted by rsm_lock_all() or rsm_try_lock_all(). Exclusive requests are
+ * released before shared ones so a promoted mutex goes back to shared ownership before that is released.
+ */
+template <class Mutex>
+void rsm_unlock_all(const rsm_lock_request<Mutex> *requests, const size_t &count)
+{
+    for (size_t i = count; i > 0; --i)
+    {
+        if (requests[i - 1].mode == rsm_lock_mode::exclusive)
+        {
+            rsm_release_request(requests[i - 1]);
+        }
+    }
+    for (size_t i = count; i > 0; --i)
+    {
+        if (requests[i - 1].mode == rsm_lock_mode::shared)
+        {
+            rsm_release_request(requests[i - 1]);
+        }
+    }
+}
+
+// the same for a fixed list of requests, e.g. rsm_lock_all(rsm_shared(a), rsm_exclusive(b))
+template <class Mutex, class... Requests>
+bool rsm_lock_all(const rsm_lock_request<Mutex> &request, const Requests &... requests)
+{
+    const rsm_lock_request<Mutex> all[] = {request, requests...};
+    return rsm_lock_all(all, 1 + sizeof...(requests));
+}
+
+template <class Mutex, class... Requests>
+bool rsm_try_lock_all(const rsm_lock_request<Mutex> &request, const Requests &... requests)
+{
+    const rsm_lock_request<Mutex> all[] = {request, requests...};
+    return rsm_try_lock_all(all, 1 + sizeof...(requests));
+}
+
+template <class Mutex, class... Requests>
+void rsm_unlock_all(const rsm_lock_request<Mutex> &request, const Requests &... requests)
+{
+    const rsm_lock_request<Mutex> all[] = {request, requests...};
+    rsm_unlock_all(all, 1 + sizeof...(requests));
+}
+
+#endif // _RSM_LOCK_ALL_H
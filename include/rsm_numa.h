@@ -0,0 +1,43 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef _RSM_NUMA_H
+#define _RSM_NUMA_H
+
+#include <cstddef>
+
+// the most numa nodes the cohort policy tells apart, nodes with higher numbers share a slot
+#ifndef RSM_NUMA_MAX_NODES
+#define RSM_NUMA_MAX_NODES 8
+#endif
+
+/**
+ * The numa topology of the machine, read once from /sys/devices/system/node/online and the
+ * /sys/devices/system/node/node<N>/cpulist of every node listed there.
+ *
+ * Setting the environment variable RSM_NUMA_NODES to a number before the first call fakes that many
+ * nodes instead, the cpus are split into that many blocks of consecutive cpus. Machines without
+ * sysfs or without numa have one node.
+ *
+ * @return the number of online numa nodes
+ */
+size_t rsm_numa_node_count();
+
+/**
+ * @return the numa node of the cpu the calling thread runs on, or the node set with
+ * rsm_numa_set_thread_node(). Always less than RSM_NUMA_MAX_NODES.
+ */
+size_t rsm_numa_current_node();
+
+/**
+ * Pretend the calling thread runs on node from now on, wherever the scheduler puts it. For tests and
+ * for threads that are pinned to the cpus of one node anyway, which saves a sched_getcpu() per call.
+ *
+ * @param node the node to report, -1 to go back to asking the scheduler
+ * @return none
+ */
+void rsm_numa_set_thread_node(int node);
+
+#endif // _RSM_NUMA_H
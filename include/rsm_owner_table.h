@@ -0,0 +1,170 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef _RSM_OWNER_TABLE_H
+#define _RSM_OWNER_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#ifndef RSM_OWNER_TABLE_CAPACITY
+#define RSM_OWNER_TABLE_CAPACITY 16
+#endif
+
+/**
+ * Fixed capacity open addressing table mapping a mutex address to a lock count.
+ *
+ * Slots are stored inline and probed linearly, erasing shifts the following slots back so
+ * there are no tombstones. Lookups, inserts and erases never allocate as long as no more
+ * than 3/4 of Capacity keys are stored. Keys beyond that go to an overflow table that is
+ * allocated the first time it is needed and kept afterwards, so a thread that holds a lot of
+ * mutexes at once allocates once instead of on every lock and unlock.
+ *
+ * This is not thread safe, it is meant to be used as thread local storage.
+ */
+template <size_t Capacity>
+class rsm_owner_table
+{
+    static_assert(Capacity >= 4 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of 2");
+
+private:
+    struct slot
+    {
+        const void *key;
+        uint64_t count;
+    };
+
+    // the most keys stored in _slots before new keys go to _overflow
+    static constexpr size_t MAX_SIZE = Capacity - Capacity / 4;
+
+    slot _slots[Capacity];
+    size_t _size;
+    std::unique_ptr<rsm_owner_table> _overflow;
+
+    static size_t home_index(const void *key)
+    {
+        // fibonacci hashing, mutex addresses are aligned so the low bits carry no information
+        return static_cast<size_t>((reinterpret_cast<uintptr_t>(key) * UINT64_C(0x9E3779B97F4A7C15)) >> 32) &
+               (Capacity - 1);
+    }
+
+    static size_t next_index(const size_t &index) { return (index + 1) & (Capacity - 1); }
+
+    slot *find_slot(const void *key)
+    {
+        for (size_t i = home_index(key);; i = next_index(i))
+        {
+            if (_slots[i].key == key)
+            {
+                return &_slots[i];
+            }
+            if (_slots[i].key == nullptr)
+            {
+                return nullptr;
+            }
+        }
+    }
+
+    void erase_slot(size_t hole)
+    {
+        // shift back every following entry that would be unreachable once the hole is empty
+        for (size_t i = next_index(hole); _slots[i].key != nullptr; i = next_index(i))
+        {
+            const size_t home = home_index(_slots[i].key);
+            // move slot i into the hole unless its home lies cyclically in (hole, i]
+            if ((i > hole && (home <= hole || home > i)) || (i < hole && (home <= hole && home > i)))
+            {
+                _slots[hole] = _slots[i];
+                hole = i;
+            }
+        }
+        _slots[hole].key = nullptr;
+        _slots[hole].count = 0;
+        _size--;
+    }
+
+public:
+    rsm_owner_table() : _slots(), _size(0), _overflow(nullptr) {}
+    rsm_owner_table(const rsm_owner_table &) = delete;
+    rsm_owner_table &operator=(const rsm_owner_table &) = delete;
+
+    /**
+     * Find the count stored for key
+     *
+     * @param key the address of a mutex, must not be null
+     * @return pointer to the count for key or nullptr if key is not in the table
+     */
+    uint64_t *find(const void *key)
+    {
+        slot *found = find_slot(key);
+        if (found != nullptr)
+        {
+            return &found->count;
+        }
+        return _overflow ? _overflow->find(key) : nullptr;
+    }
+
+    /**
+     * Find the count stored for key, adding key with a count of 0 if it is not in the table
+     *
+     * @param key the address of a mutex, must not be null
+     * @return reference to the count for key
+     */
+    uint64_t &get_or_insert(const void *key)
+    {
+        uint64_t *found = find(key);
+        if (found != nullptr)
+        {
+            return *found;
+        }
+        if (_size >= MAX_SIZE)
+        {
+            if (!_overflow)
+            {
+                _overflow.reset(new rsm_owner_table());
+            }
+            return _overflow->get_or_insert(key);
+        }
+        size_t i = home_index(key);
+        while (_slots[i].key != nullptr)
+        {
+            i = next_index(i);
+        }
+        _slots[i].key = key;
+        _slots[i].count = 0;
+        _size++;
+        return _slots[i].count;
+    }
+
+    /**
+     * Remove key from the table if it is in the table. The overflow table is kept allocated.
+     *
+     * @param key the address of a mutex, must not be null
+     * @return none
+     */
+    void erase(const void *key)
+    {
+        slot *found = find_slot(key);
+        if (found != nullptr)
+        {
+            erase_slot(static_cast<size_t>(found - _slots));
+        }
+        else if (_overflow)
+        {
+            _overflow->erase(key);
+        }
+    }
+
+    /**
+     * @return the number of keys in the table including the overflow table
+     */
+    size_t size() const { return _size + (_overflow ? _overflow->size() : 0); }
+};
+
+template <size_t Capacity>
+constexpr size_t rsm_owner_table<Capacity>::MAX_SIZE;
+
+#endif // _RSM_OWNER_TABLE_H
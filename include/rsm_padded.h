@@ -0,0 +1,105 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef _RSM_PADDED_H
+#define _RSM_PADDED_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+
+// the size of the cache line two cpus false share on, state written by different groups of threads is kept
+// this far apart
+#ifndef RSM_CACHE_LINE_SIZE
+#define RSM_CACHE_LINE_SIZE 64
+#endif
+
+/**
+ * Holds a T at the start of its own cache lines. Nothing else is placed on the lines the T uses, so
+ * neighbouring elements of an array of these never false share.
+ */
+template <class T>
+struct alignas(RSM_CACHE_LINE_SIZE) rsm_padded
+{
+    T value;
+
+    template <class... Args>
+    explicit rsm_padded(Args &&... args) : value(std::forward<Args>(args)...)
+    {
+    }
+};
+
+/**
+ * A fixed size array of T, each one on its own cache lines. Use this instead of new T[count] or std::vector<T>
+ * for tables of mutexes. The elements of a plain array sit right next to each other, so the last members of
+ * one mutex share a cache line with the first members of the next. Before C++17 operator new only guarantees
+ * the alignment of std::max_align_t, so this array aligns its storage itself instead of relying on new[]. The
+ * elements are constructed in place and never move, so T does not have to be copyable or movable.
+ */
+template <class T>
+class rsm_padded_array
+{
+private:
+    typedef rsm_padded<T> element;
+
+    size_t _size;
+    // what operator new returned, _elements points at the first cache line boundary in it
+    void *_storage;
+    element *_elements;
+
+public:
+    /**
+     * Constructs count elements, each with the same args.
+     *
+     * @param count number of elements
+     * @param args passed to the constructor of every element
+     */
+    template <class... Args>
+    explicit rsm_padded_array(const size_t &count, const Args &... args)
+        : _size(0), _storage(nullptr), _elements(nullptr)
+    {
+        size_t space = count * sizeof(element) + RSM_CACHE_LINE_SIZE;
+        _storage = ::operator new(space);
+        void *aligned = _storage;
+        _elements = static_cast<element *>(std::align(RSM_CACHE_LINE_SIZE, count * sizeof(element), aligned, space));
+        try
+        {
+            for (; _size < count; ++_size)
+            {
+                new (&_elements[_size]) element(args...);
+            }
+        }
+        catch (...)
+        {
+            clear();
+            throw;
+        }
+    }
+
+    ~rsm_padded_array() { clear(); }
+    rsm_padded_array(const rsm_padded_array &) = delete;
+    rsm_padded_array &operator=(const rsm_padded_array &) = delete;
+
+    size_t size() const { return _size; }
+    T &operator[](const size_t &index) { return _elements[index].value; }
+    const T &operator[](const size_t &index) const { return _elements[index].value; }
+
+private:
+    void clear()
+    {
+        while (_size > 0)
+        {
+            --_size;
+            _elements[_size].~element();
+        }
+        ::operator delete(_storage);
+        _storage = nullptr;
+        _elements = nullptr;
+    }
+};
+
+#endif // _RSM_PADDED_H
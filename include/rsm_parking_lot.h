@@ -0,0 +1,106 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef _RSM_PARKING_LOT_H
+#define _RSM_PARKING_LOT_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include "rsm_padded.h"
+
+// number of buckets in the global parking lot, must be a power of 2. threads parked on addresses that
+// hash to the same bucket share its mutex
+#ifndef RSM_PARKING_LOT_BUCKETS
+#define RSM_PARKING_LOT_BUCKETS 256
+#endif
+
+static_assert((RSM_PARKING_LOT_BUCKETS & (RSM_PARKING_LOT_BUCKETS - 1)) == 0,
+    "RSM_PARKING_LOT_BUCKETS must be a power of 2");
+
+// a thread waiting in the parking lot, lives on the waiting threads stack
+struct rsm_parked_thread
+{
+    const void *address;
+    // what the thread waits for, a single bit chosen by whoever parks on the address
+    uint32_t kind;
+    bool unparked;
+    rsm_parked_thread *next;
+    std::condition_variable gate;
+
+    rsm_parked_thread(const void *parked_on, const uint32_t &parked_kind)
+        : address(parked_on), kind(parked_kind), unparked(false), next(nullptr)
+    {
+    }
+};
+
+/**
+ * One bucket of the global parking lot, a FIFO queue of the threads parked on the addresses that hash
+ * to it. Every member function must be called with mutex locked.
+ */
+struct alignas(RSM_CACHE_LINE_SIZE) rsm_parking_bucket
+{
+    std::mutex mutex;
+    rsm_parked_thread *head;
+    rsm_parked_thread *tail;
+
+    rsm_parking_bucket() : head(nullptr), tail(nullptr) {}
+
+    void push(rsm_parked_thread *parked);
+
+    /**
+     * @return the kinds of every thread parked on address or-ed together, 0 if there is none
+     */
+    uint32_t parked_kinds(const void *address) const;
+
+    /**
+     * @return the number of threads of one of kinds parked on address
+     */
+    size_t parked_count(const void *address, const uint32_t &kinds) const;
+
+    /**
+     * Wake up to max threads of one of kinds parked on address, in the order they parked
+     *
+     * @return the number of threads woken
+     */
+    size_t unpark(const void *address, const uint32_t &kinds, const size_t &max);
+};
+
+/**
+ * @return the bucket threads waiting on address park in
+ */
+rsm_parking_bucket &rsm_parking_bucket_for(const void *address);
+
+/**
+ * Park the calling thread on address until another thread unparks it, unless validate() returns false.
+ *
+ * validate() runs with the bucket locked, so a thread that changes the state validate() checks and then
+ * unparks the threads parked on address can not miss this one. It is the place to set a flag telling
+ * the other threads that someone is parked.
+ *
+ *
+ * @param address any address, usually of the object the thread waits for
+ * @param kind what the thread waits for, see rsm_parking_bucket::unpark()
+ * @param validate returns true if the thread still has to wait
+ * @return false if validate() returned false and the thread did not park
+ */
+template <class Validate>
+bool rsm_park(const void *address, const uint32_t &kind, Validate validate)
+{
+    rsm_parking_bucket &bucket = rsm_parking_bucket_for(address);
+    std::unique_lock<std::mutex> lock(bucket.mutex);
+    if (!validate())
+    {
+        return false;
+    }
+    rsm_parked_thread self(address, kind);
+    bucket.push(&self);
+    self.gate.wait(lock, [&self] { return self.unparked; });
+    return true;
+}
+
+#endif // _RSM_PARKING_LOT_H
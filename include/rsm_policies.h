@@ -0,0 +1,141 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef _RSM_POLICIES_H
+#define _RSM_POLICIES_H
+
+#include <cstddef>
+
+/**
+ * Which threads go first when threads are waiting for both shared and exclusive ownership.
+ * A thread waiting for promotion is always next, whatever the policy.
+ * - phase_fair: threads calling lock_shared() are blocked while a thread is waiting in lock(). When
+ * exclusive ownership is released the threads that were already waiting for shared ownership are admitted
+ * as one batch, then the next thread in the exclusive queue goes. Neither side can starve the other.
+ * - reader_preferring: threads calling lock_shared() are only blocked by exclusive ownership or a promotion.
+ * Gives the most shared throughput, a steady stream of readers can starve threads waiting in lock().
+ * - writer_preferring: threads waiting for shared ownership are only admitted once the exclusive queue is
+ * empty. Gives the lowest exclusive latency, a steady stream of writers can starve readers.
+ */
+enum class rsm_fairness
+{
+    phase_fair,
+    reader_preferring,
+    writer_preferring
+};
+
+/**
+ * Compile time options of basic_recursive_shared_mutex. Every option has a default here, a policy only
+ * has to be given to change it and the order policies are given in does not matter.
+ * A feature that is turned off adds no members and no code to the mutex.
+ */
+struct rsm_default_policies
+{
+    // recursive exclusive and shared locking and shared locking by the exclusive owner, needs owner_tracking
+    static constexpr bool recursion = true;
+    // try_promotion() and its timed variants
+    static constexpr bool promotion = true;
+    // remember which thread has exclusive ownership so unlock() by any other thread is caught
+    static constexpr bool owner_tracking = true;
+    // throw std::logic_error on misuse instead of ignoring it
+#ifdef RSM_DEBUG_ASSERTION
+    static constexpr bool debug_assertions = true;
+#else
+    static constexpr bool debug_assertions = false;
+#endif
+    static constexpr rsm_fairness fairness = rsm_fairness::phase_fair;
+    // number of cache line sized slots shared owners are counted in, 0 counts them in the state word, needs recursion
+    static constexpr size_t reader_shards = 0;
+    // how many times in a row ownership may go to waiting threads on the same numa node, 0 ignores nodes
+    static constexpr size_t numa_cohort = 0;
+};
+
+// each policy overrides one option, the virtual base makes the override dominate the default
+template <bool Enabled>
+struct rsm_recursion : virtual rsm_default_policies
+{
+    static constexpr bool recursion = Enabled;
+};
+
+template <bool Enabled>
+struct rsm_promotion : virtual rsm_default_policies
+{
+    static constexpr bool promotion = Enabled;
+};
+
+template <bool Enabled>
+struct rsm_owner_tracking : virtual rsm_default_policies
+{
+    static constexpr bool owner_tracking = Enabled;
+};
+
+template <bool Enabled>
+struct rsm_debug_assertions : virtual rsm_default_policies
+{
+    static constexpr bool debug_assertions = Enabled;
+};
+
+template <rsm_fairness Fairness>
+struct rsm_fairness_policy : virtual rsm_default_policies
+{
+    static constexpr rsm_fairness fairness = Fairness;
+};
+
+/**
+ * Count threads taking shared ownership in Shards slots of their own cache line instead of in the state word.
+ * A reader only writes to the slot of the cpu it runs on, so readers on different cores do not contend
+ * on one cache line. Taking exclusive ownership has to read every slot, so writers get slower the more
+ * slots there are. Threads that get shared ownership after waiting for it are still counted in the
+ * state word.
+ */
+template <size_t Shards>
+struct rsm_reader_shards : virtual rsm_default_policies
+{
+    static constexpr size_t reader_shards = Shards;
+};
+
+/**
+ * Hand exclusive ownership and batches of waiting readers to threads on the numa node of the last
+ * exclusive owner first, so the lock and the data it protects stay in that nodes caches. After
+ * LocalHandoffs hand-offs in a row ownership goes to the longest waiting thread on another node, so no
+ * node waits for more than LocalHandoffs hand-offs. Promotions are still served in the order they were
+ * asked for. The nodes come from rsm_numa.h.
+ */
+template <size_t LocalHandoffs>
+struct rsm_numa_cohort : virtual rsm_default_policies
+{
+    static constexpr size_t numa_cohort = LocalHandoffs;
+};
+
+/**
+ * Replaces the whole mutex with one that has no members and does nothing, every lock succeeds right away.
+ * For builds that only ever run one thread. Must be the only policy given.
+ */
+struct rsm_null_mutex
+{
+};
+
+template <bool Enabled>
+constexpr bool rsm_recursion<Enabled>::recursion;
+template <bool Enabled>
+constexpr bool rsm_promotion<Enabled>::promotion;
+template <bool Enabled>
+constexpr bool rsm_owner_tracking<Enabled>::owner_tracking;
+template <bool Enabled>
+constexpr bool rsm_debug_assertions<Enabled>::debug_assertions;
+template <rsm_fairness Fairness>
+constexpr rsm_fairness rsm_fairness_policy<Fairness>::fairness;
+template <size_t Shards>
+constexpr size_t rsm_reader_shards<Shards>::reader_shards;
+template <size_t LocalHandoffs>
+constexpr size_t rsm_numa_cohort<LocalHandoffs>::numa_cohort;
+
+// the options resulting from a list of policies
+template <class... Policies>
+struct rsm_policy_selector : virtual rsm_default_policies, Policies...
+{
+};
+
+#endif // _RSM_POLICIES_H
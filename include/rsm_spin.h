@@ -0,0 +1,73 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef _RSM_SPIN_H
+#define _RSM_SPIN_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// the longest a thread spins waiting for ownership before parking, in nanoseconds. 0 disables spinning
+#ifndef RSM_MAX_SPIN_NS
+#define RSM_MAX_SPIN_NS 20000
+#endif
+
+// the shortest spin budget used before any hold times have been observed, in nanoseconds
+#ifndef RSM_MIN_SPIN_NS
+#define RSM_MIN_SPIN_NS 1000
+#endif
+
+// number of threads spinning in any recursive_shared_mutex, once there is one per core spinning only
+// takes cpu time away from the threads we are waiting for
+extern std::atomic<uint32_t> rsm_spinning_threads;
+extern const uint32_t rsm_max_spinning_threads;
+
+inline int64_t rsm_steady_now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// tell the cpu we are in a spin loop so it can yield pipeline resources to a sibling hyperthread
+inline void rsm_cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield" ::: "memory");
+#endif
+}
+
+/**
+ * Exponential backoff for spin loops, every call to pause() spins twice as long as the
+ * previous one up to a limit so spinning threads do not hammer the cache line they wait on.
+ */
+class rsm_backoff
+{
+private:
+    static const uint32_t MAX_PAUSES = 64;
+    uint32_t _pauses;
+
+public:
+    rsm_backoff() : _pauses(1) {}
+    void pause()
+    {
+        for (uint32_t i = 0; i < _pauses; ++i)
+        {
+            rsm_cpu_relax();
+        }
+        if (_pauses < MAX_PAUSES)
+        {
+            _pauses = _pauses * 2;
+        }
+    }
+};
+
+#endif // _RSM_SPIN_H
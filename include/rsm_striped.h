@@ -0,0 +1,188 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef _RSM_STRIPED_H
+#define _RSM_STRIPED_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+
+#include "recursive_shared_mutex.h"
+#include "rsm_padded.h"
+
+/**
+ * A table of mutexes keys are hashed onto, for guarding the entries of a big hash map without one mutex
+ * per entry. The stripe count is fixed, either at compile time with rsm_striped<N> or at run time by
+ * passing it to the constructor of rsm_striped<0>. Every stripe has its own cache lines.
+ *
+ * Locking a key locks its stripe, so two keys that hash to the same stripe share one mutex. With a
+ * recursive Mutex a thread can lock any number of keys that collide: exclusive or shared ownership of
+ * one of them simply recurses on the stripe. A thread that has shared ownership of a key and wants to
+ * write it, or any key that may collide with it, must use try_promotion() instead of lock().
+ *
+ * lock_all_stripes() takes exclusive ownership of every stripe in index order, for resizing or
+ * rehashing the whole map. It must be called without ownership of any stripe, another thread
+ * doing the same could otherwise be waiting for the stripe we have while we wait for one of its.
+ */
+template <size_t Stripes, class Mutex = recursive_shared_mutex>
+class rsm_striped
+{
+private:
+    rsm_padded_array<Mutex> _stripes;
+
+public:
+    rsm_striped() : _stripes(Stripes)
+    {
+        static_assert(Stripes != 0, "rsm_striped<0> needs the stripe count as a constructor argument");
+    }
+
+    /**
+     * @param stripes the number of stripes, only for rsm_striped<0>
+     */
+    explicit rsm_striped(const size_t &stripes) : _stripes(stripes)
+    {
+        static_assert(Stripes == 0, "the stripe count of rsm_striped<N> is N");
+        if (stripes == 0)
+        {
+            throw std::invalid_argument("rsm_striped needs at least one stripe");
+        }
+    }
+
+    rsm_striped(const rsm_striped &) = delete;
+    rsm_striped &operator=(const rsm_striped &) = delete;
+
+    size_t stripes() const { return _stripes.size(); }
+
+    /**
+     * The hash of key mixed so that keys with a common stride still spread over all stripes, std::hash
+     * of integers is the identity. Uses the finalizer of murmur3, every bit of the hash affects the low
+     * bits used for the stripe.
+     */
+    template <class Key, class Hash = std::hash<Key> >
+    static uint64_t mixed_hash(const Key &key)
+    {
+        uint64_t mixed = static_cast<uint64_t>(Hash()(key));
+        mixed ^= mixed >> 33;
+        mixed *= UINT64_C(0xFF51AFD7ED558CCD);
+        mixed ^= mixed >> 33;
+        mixed *= UINT64_C(0xC4CEB9FE1A85EC53);
+        mixed ^= mixed >> 33;
+        return mixed;
+    }
+
+    // the index of the stripe a key with this mixed_hash() is guarded by
+    size_t stripe_of_hash(const uint64_t &mixed) const { return static_cast<size_t>(mixed % _stripes.size()); }
+
+    // the index of the stripe key is guarded by
+    template <class Key, class Hash = std::hash<Key> >
+    size_t stripe_of(const Key &key) const
+    {
+        return stripe_of_hash(mixed_hash<Key, Hash>(key));
+    }
+
+    Mutex &stripe(const size_t &index) { return _stripes[index]; }
+
+    template <class Key>
+    Mutex &stripe_for(const Key &key)
+    {
+        return _stripes[stripe_of(key)];
+    }
+
+    template <class Key>
+    void lock(const Key &key)
+    {
+        stripe_for(key).lock();
+    }
+
+    template <class Key>
+    bool try_lock(const Key &key)
+    {
+        return stripe_for(key).try_lock();
+    }
+
+    template <class Key>
+    void unlock(const Key &key)
+    {
+        stripe_for(key).unlock();
+    }
+
+    template <class Key>
+    void lock_shared(const Key &key)
+    {
+        stripe_for(key).lock_shared();
+    }
+
+    template <class Key>
+    bool try_lock_shared(const Key &key)
+    {
+        return stripe_for(key).try_lock_shared();
+    }
+
+    template <class Key>
+    void unlock_shared(const Key &key)
+    {
+        stripe_for(key).unlock_shared();
+    }
+
+    /**
+     * Promote shared ownership of the stripe of key to exclusive ownership, see try_promotion() of
+     * the mutex. Exclusive ownership is released with unlock(key) and the shared ownership is kept.
+     *
+     * @return: false if the stripe could not be promoted, the thread still has shared ownership
+     */
+    template <class Key>
+    bool try_promotion(const Key &key)
+    {
+        return stripe_for(key).try_promotion();
+    }
+
+    /**
+     * Take exclusive ownership of every stripe, lowest index first.
+     */
+    void lock_all_stripes()
+    {
+        for (size_t i = 0; i < _stripes.size(); ++i)
+        {
+            _stripes[i].lock();
+        }
+    }
+
+    /**
+     * Take exclusive ownership of every stripe without blocking.
+     *
+     * @return: false if any stripe was owned by another thread, no stripe is locked then
+     */
+    bool try_lock_all_stripes()
+    {
+        for (size_t i = 0; i < _stripes.size(); ++i)
+        {
+            if (!_stripes[i].try_lock())
+            {
+                while (i > 0)
+                {
+                    --i;
+                    _stripes[i].unlock();
+                }
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Release every stripe locked by lock_all_stripes(), highest index first.
+     */
+    void unlock_all_stripes()
+    {
+        for (size_t i = _stripes.size(); i > 0; --i)
+        {
+            _stripes[i - 1].unlock();
+        }
+    }
+};
+
+#endif // _RSM_STRIPED_H
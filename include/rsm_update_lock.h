@@ -0,0 +1,83 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef _RSM_UPDATE_LOCK_H
+#define _RSM_UPDATE_LOCK_H
+
+#include <mutex>
+
+/**
+ * RAII guard for update ownership, like std::shared_lock is for shared ownership.
+ *
+ * The guard remembers whether it upgraded to exclusive ownership so that going out of scope
+ * releases the exclusive lock as well as the update lock.
+ */
+template <class Mutex>
+class rsm_update_lock
+{
+private:
+    Mutex *_mutex;
+    bool _owns;
+    bool _upgraded;
+
+public:
+    explicit rsm_update_lock(Mutex &mutex) : _mutex(&mutex), _owns(false), _upgraded(false)
+    {
+        _mutex->lock_update();
+        _owns = true;
+    }
+
+    rsm_update_lock(Mutex &mutex, std::try_to_lock_t) : _mutex(&mutex), _owns(false), _upgraded(false)
+    {
+        _owns = _mutex->try_lock_update();
+    }
+
+    ~rsm_update_lock() { unlock(); }
+    rsm_update_lock(const rsm_update_lock &) = delete;
+    rsm_update_lock &operator=(const rsm_update_lock &) = delete;
+
+    /**
+     * Turn update ownership into exclusive ownership, see upgrade() of the mutex
+     */
+    void upgrade()
+    {
+        if (_owns && !_upgraded)
+        {
+            _mutex->upgrade();
+            _upgraded = true;
+        }
+    }
+
+    /**
+     * Release exclusive ownership obtained by upgrade() and keep update ownership
+     */
+    void unlock_upgrade()
+    {
+        if (_upgraded)
+        {
+            _mutex->unlock();
+            _upgraded = false;
+        }
+    }
+
+    /**
+     * Release exclusive ownership if upgraded, then update ownership
+     */
+    void unlock()
+    {
+        unlock_upgrade();
+        if (_owns)
+        {
+            _mutex->unlock_update();
+            _owns = false;
+        }
+    }
+
+    bool owns_lock() const { return _owns; }
+    bool upgraded() const { return _upgraded; }
+    explicit operator bool() const { return _owns; }
+};
+
+#endif // _RSM_UPDATE_LOCK_H
@@ -0,0 +1,10 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "include/rsm_bravo.h"
+
+std::atomic<const void *> rsm_bravo_visible_readers[RSM_BRAVO_TABLE_SIZE] = {};
+
+thread_local rsm_owner_table<RSM_OWNER_TABLE_CAPACITY> rsm_bravo_read_counts;
@@ -0,0 +1,353 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "include/rsm_compact.h"
+#include "include/rsm_parking_lot.h"
+#include "include/rsm_policies.h"
+#include "include/rsm_spin.h"
+
+#include <stdexcept>
+
+thread_local rsm_owner_table<RSM_OWNER_TABLE_CAPACITY> rsm_compact_shared_counts;
+thread_local rsm_owner_table<RSM_OWNER_TABLE_CAPACITY> rsm_compact_exclusive_counts;
+
+constexpr uint64_t rsm_compact_mutex::READER_MASK;
+constexpr uint64_t rsm_compact_mutex::WRITER_HELD;
+constexpr uint64_t rsm_compact_mutex::WRITERS_PARKED;
+constexpr uint64_t rsm_compact_mutex::PROMOTION_PENDING;
+constexpr uint64_t rsm_compact_mutex::READERS_PARKED;
+constexpr uint32_t rsm_compact_mutex::PARK_WRITER;
+constexpr uint32_t rsm_compact_mutex::PARK_READER;
+constexpr uint32_t rsm_compact_mutex::PARK_PROMOTION;
+
+// the exclusive counts keep the shared locks taken by the exclusive owner in the high 32 bits
+static const uint64_t EXCLUSIVE_LOCK = 1;
+static const uint64_t SHARED_WHILE_EXCLUSIVE = uint64_t(1) << 32;
+static const uint64_t EXCLUSIVE_LOCK_MASK = SHARED_WHILE_EXCLUSIVE - 1;
+
+// how many times a thread backs off and retries before it parks, when there is a core to spin on
+static const int COMPACT_SPINS = 8;
+
+bool rsm_compact_mutex::try_lock_exclusive()
+{
+    uint64_t state = _state.load(std::memory_order_relaxed);
+    while ((state & (READER_MASK | WRITER_HELD | PROMOTION_PENDING)) == 0)
+    {
+        if (_state.compare_exchange_weak(state, state | WRITER_HELD, std::memory_order_acquire,
+                std::memory_order_relaxed))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void rsm_compact_mutex::lock_exclusive()
+{
+    rsm_backoff backoff;
+    int spins = (rsm_max_spinning_threads == 0) ? COMPACT_SPINS : 0;
+    while (!try_lock_exclusive())
+    {
+        if (spins < COMPACT_SPINS)
+        {
+            backoff.pause();
+            spins++;
+            continue;
+        }
+        // parked writers are woken to try again, a thread calling lock() may have got in first
+        rsm_park(this, PARK_WRITER, [this] {
+            uint64_t state = _state.load();
+            while ((state & (READER_MASK | WRITER_HELD | PROMOTION_PENDING)) != 0)
+            {
+                if ((state & WRITERS_PARKED) || _state.compare_exchange_weak(state, state | WRITERS_PARKED))
+                {
+                    return true;
+                }
+            }
+            return false;
+        });
+    }
+}
+
+bool rsm_compact_mutex::try_lock_shared_fast()
+{
+    uint64_t state = _state.load(std::memory_order_relaxed);
+    while ((state & (WRITER_HELD | WRITERS_PARKED | PROMOTION_PENDING)) == 0)
+    {
+        if (_state.compare_exchange_weak(state, state + 1, std::memory_order_acquire, std::memory_order_relaxed))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void rsm_compact_mutex::release_exclusive_ownership()
+{
+    const uint64_t previous_state = _state.fetch_and(~WRITER_HELD, std::memory_order_release);
+    if (previous_state & (WRITERS_PARKED | READERS_PARKED))
+    {
+        unpark_waiters(true);
+    }
+}
+
+void rsm_compact_mutex::release_shared_ownership()
+{
+    const uint64_t previous_state = _state.fetch_sub(1, std::memory_order_release);
+    const uint64_t readers = (previous_state - 1) & READER_MASK;
+    // a parked writer needs every reader gone, the thread waiting for promotion every reader but itself
+    if (((previous_state & WRITERS_PARKED) && readers == 0) || ((previous_state & PROMOTION_PENDING) && readers <= 1))
+    {
+        unpark_waiters(false);
+    }
+}
+
+void rsm_compact_mutex::unpark_waiters(const bool &writer_released)
+{
+    rsm_parking_bucket &bucket = rsm_parking_bucket_for(this);
+    std::lock_guard<std::mutex> _lock(bucket.mutex);
+    uint64_t state = _state.load();
+    if (state & WRITER_HELD)
+    {
+        // a thread calling lock() got in, it wakes the parked threads when it is done
+        return;
+    }
+    if (state & PROMOTION_PENDING)
+    {
+        if ((state & READER_MASK) <= 1)
+        {
+            bucket.unpark(this, PARK_PROMOTION, 1);
+        }
+        return;
+    }
+    const uint32_t kinds = bucket.parked_kinds(this);
+    if ((kinds & PARK_READER) && (writer_released || (kinds & PARK_WRITER) == 0))
+    {
+        // admit every parked reader at once, they are counted before they wake up so the parked writers
+        // can not get in between
+        const uint64_t readers = bucket.parked_count(this, PARK_READER);
+        while (!_state.compare_exchange_weak(state, (state + readers) & ~READERS_PARKED))
+        {
+            if (state & (WRITER_HELD | PROMOTION_PENDING))
+            {
+                return;
+            }
+        }
+        bucket.unpark(this, PARK_READER, readers);
+        return;
+    }
+    if ((kinds & PARK_WRITER) == 0)
+    {
+        // the last parked writer was woken before and got ownership, nobody blocks new readers anymore
+        if (state & WRITERS_PARKED)
+        {
+            _state.fetch_and(~WRITERS_PARKED);
+        }
+        return;
+    }
+    // WRITERS_PARKED stays set, even for the last parked writer, so new readers can not get in before it
+    if ((state & READER_MASK) == 0)
+    {
+        bucket.unpark(this, PARK_WRITER, 1);
+    }
+}
+
+void rsm_compact_mutex::lock()
+{
+    uint64_t *our_counts = rsm_compact_exclusive_counts.find(this);
+    if (our_counts != nullptr)
+    {
+        *our_counts = *our_counts + EXCLUSIVE_LOCK;
+        return;
+    }
+    if (rsm_default_policies::debug_assertions && rsm_compact_shared_counts.find(this) != nullptr)
+    {
+        throw std::logic_error("lock can deadlock when called with shared ownership, use try_promotion");
+    }
+    lock_exclusive();
+    rsm_compact_exclusive_counts.get_or_insert(this) = EXCLUSIVE_LOCK;
+}
+
+bool rsm_compact_mutex::try_lock()
+{
+    uint64_t *our_counts = rsm_compact_exclusive_counts.find(this);
+    if (our_counts != nullptr)
+    {
+        *our_counts = *our_counts + EXCLUSIVE_LOCK;
+        return true;
+    }
+    if (!try_lock_exclusive())
+    {
+        return false;
+    }
+    rsm_compact_exclusive_counts.get_or_insert(this) = EXCLUSIVE_LOCK;
+    return true;
+}
+
+void rsm_compact_mutex::unlock()
+{
+    uint64_t *our_counts = rsm_compact_exclusive_counts.find(this);
+    if (our_counts == nullptr || (*our_counts & EXCLUSIVE_LOCK_MASK) == 0)
+    {
+        if (rsm_default_policies::debug_assertions)
+        {
+            throw std::logic_error("unlock called on a thread with no exclusive lock");
+        }
+        return;
+    }
+    *our_counts = *our_counts - EXCLUSIVE_LOCK;
+    if ((*our_counts & EXCLUSIVE_LOCK_MASK) != 0)
+    {
+        return;
+    }
+    const uint64_t shared_while_exclusive = *our_counts / SHARED_WHILE_EXCLUSIVE;
+    uint64_t *our_shared_count = rsm_compact_shared_counts.find(this);
+    if (our_shared_count != nullptr)
+    {
+        // a promoted thread goes back to the shared ownership it still has, any shared locks it took while
+        // promoted become shared locks as well
+        *our_shared_count = *our_shared_count + shared_while_exclusive;
+    }
+    else if (shared_while_exclusive != 0)
+    {
+        // exclusive ownership lasts until the shared locks taken with it are released too
+        return;
+    }
+    rsm_compact_exclusive_counts.erase(this);
+    release_exclusive_ownership();
+}
+
+bool rsm_compact_mutex::try_promotion()
+{
+    uint64_t *our_counts = rsm_compact_exclusive_counts.find(this);
+    if (our_counts != nullptr)
+    {
+        *our_counts = *our_counts + EXCLUSIVE_LOCK;
+        return true;
+    }
+    const uint64_t our_readers = (rsm_compact_shared_counts.find(this) != nullptr) ? 1 : 0;
+    uint64_t state = _state.load();
+    do
+    {
+        if (state & (WRITER_HELD | PROMOTION_PENDING))
+        {
+            return false;
+        }
+    } while (!_state.compare_exchange_weak(state, state | PROMOTION_PENDING));
+    // nobody can get in now, wait for the other readers to leave. the last one wakes us
+    while (true)
+    {
+        state = _state.load();
+        if ((state & READER_MASK) == our_readers)
+        {
+            if (_state.compare_exchange_strong(state, (state | WRITER_HELD) & ~PROMOTION_PENDING, std::memory_order_acquire))
+            {
+                break;
+            }
+            continue;
+        }
+        rsm_park(this, PARK_PROMOTION, [this, our_readers] { return (_state.load() & READER_MASK) != our_readers; });
+    }
+    rsm_compact_exclusive_counts.get_or_insert(this) = EXCLUSIVE_LOCK;
+    return true;
+}
+
+void rsm_compact_mutex::lock_shared()
+{
+    uint64_t *our_shared_count = rsm_compact_shared_counts.find(this);
+    if (our_shared_count != nullptr)
+    {
+        *our_shared_count = *our_shared_count + 1;
+        return;
+    }
+    uint64_t *our_counts = rsm_compact_exclusive_counts.find(this);
+    if (our_counts != nullptr)
+    {
+        *our_counts = *our_counts + SHARED_WHILE_EXCLUSIVE;
+        return;
+    }
+    rsm_backoff backoff;
+    int spins = (rsm_max_spinning_threads == 0) ? COMPACT_SPINS : 0;
+    while (!try_lock_shared_fast())
+    {
+        if (spins < COMPACT_SPINS)
+        {
+            backoff.pause();
+            spins++;
+            continue;
+        }
+        const bool parked = rsm_park(this, PARK_READER, [this] {
+            uint64_t state = _state.load();
+            while ((state & (WRITER_HELD | WRITERS_PARKED | PROMOTION_PENDING)) != 0)
+            {
+                if ((state & READERS_PARKED) || _state.compare_exchange_weak(state, state | READERS_PARKED))
+                {
+                    return true;
+                }
+            }
+            return false;
+        });
+        if (parked)
+        {
+            // parked readers are only woken once they have been counted as shared owners
+            std::atomic_thread_fence(std::memory_order_acquire);
+            break;
+        }
+    }
+    rsm_compact_shared_counts.get_or_insert(this) = 1;
+}
+
+bool rsm_compact_mutex::try_lock_shared()
+{
+    uint64_t *our_shared_count = rsm_compact_shared_counts.find(this);
+    if (our_shared_count != nullptr)
+    {
+        *our_shared_count = *our_shared_count + 1;
+        return true;
+    }
+    uint64_t *our_counts = rsm_compact_exclusive_counts.find(this);
+    if (our_counts != nullptr)
+    {
+        *our_counts = *our_counts + SHARED_WHILE_EXCLUSIVE;
+        return true;
+    }
+    if (!try_lock_shared_fast())
+    {
+        return false;
+    }
+    rsm_compact_shared_counts.get_or_insert(this) = 1;
+    return true;
+}
+
+void rsm_compact_mutex::unlock_shared()
+{
+    uint64_t *our_counts = rsm_compact_exclusive_counts.find(this);
+    if (our_counts != nullptr && *our_counts >= SHARED_WHILE_EXCLUSIVE)
+    {
+        *our_counts = *our_counts - SHARED_WHILE_EXCLUSIVE;
+        if (*our_counts == 0)
+        {
+            rsm_compact_exclusive_counts.erase(this);
+            release_exclusive_ownership();
+        }
+        return;
+    }
+    uint64_t *our_shared_count = rsm_compact_shared_counts.find(this);
+    if (our_shared_count == nullptr)
+    {
+        if (rsm_default_policies::debug_assertions)
+        {
+            throw std::logic_error("can not unlock_shared more times than we locked for shared ownership");
+        }
+        return;
+    }
+    *our_shared_count = *our_shared_count - 1;
+    if (*our_shared_count != 0)
+    {
+        return;
+    }
+    rsm_compact_shared_counts.erase(this);
+    release_shared_ownership();
+}
@@ -0,0 +1,278 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "include/rsm_epoch.h"
+#include "include/rsm_policies.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+static std::atomic<uint64_t> rsm_epoch_next_domain_id(1);
+
+/**
+ * The records this thread has claimed, one per domain it entered a read section of. Released when the
+ * thread exits so other threads can reuse them.
+ */
+class rsm_epoch_thread_records
+{
+private:
+    std::vector<std::pair<uint64_t, std::shared_ptr<rsm_epoch_record> > > _records;
+
+public:
+    ~rsm_epoch_thread_records()
+    {
+        for (auto &entry : _records)
+        {
+            entry.second->in_use.store(false, std::memory_order_release);
+        }
+    }
+
+    rsm_epoch_record *find(const uint64_t &domain_id)
+    {
+        for (auto &entry : _records)
+        {
+            if (entry.first == domain_id)
+            {
+                return entry.second.get();
+            }
+        }
+        return nullptr;
+    }
+
+    void add(const uint64_t &domain_id, const std::shared_ptr<rsm_epoch_record> &record)
+    {
+        // a record nobody else holds belonged to a domain that has been destroyed
+        _records.erase(std::remove_if(_records.begin(), _records.end(),
+                           [](const std::pair<uint64_t, std::shared_ptr<rsm_epoch_record> > &entry) {
+                               return entry.second.use_count() == 1;
+                           }),
+            _records.end());
+        _records.emplace_back(domain_id, record);
+    }
+};
+
+static thread_local rsm_epoch_thread_records rsm_epoch_this_thread;
+
+// before C++17 operator new only guarantees the alignment of std::max_align_t, so the record is placed on a
+// cache line boundary by hand. The shared_ptr keeps its reference counts in a separate allocation.
+static std::shared_ptr<rsm_epoch_record> rsm_epoch_new_record()
+{
+    size_t space = sizeof(rsm_epoch_record) + RSM_CACHE_LINE_SIZE;
+    void *storage = ::operator new(space);
+    void *aligned = storage;
+    std::align(RSM_CACHE_LINE_SIZE, sizeof(rsm_epoch_record), aligned, space);
+    // if the shared_ptr can not be created it calls the deleter itself
+    return std::shared_ptr<rsm_epoch_record>(new (aligned) rsm_epoch_record(), [storage](rsm_epoch_record *record) {
+        record->~rsm_epoch_record();
+        ::operator delete(storage);
+    });
+}
+
+rsm_epoch_domain::rsm_epoch_domain(bool background_reclaim)
+    : _id(rsm_epoch_next_domain_id.fetch_add(1, std::memory_order_relaxed)), _epoch(1),
+      _background(background_reclaim), _stopping(false)
+{
+}
+
+rsm_epoch_domain::~rsm_epoch_domain()
+{
+    {
+        std::lock_guard<std::mutex> _lock(_mutex);
+        _stopping = true;
+        _reclaimer_gate.notify_one();
+    }
+    if (_reclaimer.joinable())
+    {
+        _reclaimer.join();
+    }
+    free_retired(_retired);
+}
+
+rsm_epoch_record *rsm_epoch_domain::record_for_this_thread()
+{
+    rsm_epoch_record *record = rsm_epoch_this_thread.find(_id);
+    if (record == nullptr)
+    {
+        record = register_this_thread();
+    }
+    return record;
+}
+
+rsm_epoch_record *rsm_epoch_domain::register_this_thread()
+{
+    std::lock_guard<std::mutex> _lock(_mutex);
+    std::shared_ptr<rsm_epoch_record> record;
+    for (auto &candidate : _records)
+    {
+        bool in_use = false;
+        if (candidate->in_use.compare_exchange_strong(in_use, true, std::memory_order_acquire))
+        {
+            record = candidate;
+            break;
+        }
+    }
+    if (!record)
+    {
+        record = rsm_epoch_new_record();
+        _records.push_back(record);
+    }
+    rsm_epoch_this_thread.add(_id, record);
+    return record.get();
+}
+
+uint64_t rsm_epoch_domain::oldest_active_epoch()
+{
+    // pairs with the fence in lock_shared(), either we see the reader's epoch or it sees everything
+    // that was unlinked before the objects we are about to free were retired
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t oldest = std::numeric_limits<uint64_t>::max();
+    for (auto &record : _records)
+    {
+        const uint64_t epoch = record->epoch.load(std::memory_order_acquire);
+        if (epoch != 0)
+        {
+            oldest = std::min(oldest, epoch);
+        }
+    }
+    return oldest;
+}
+
+void rsm_epoch_domain::free_retired(std::vector<retired_object> &objects)
+{
+    for (auto &object : objects)
+    {
+        object.deleter(object.ptr);
+    }
+    objects.clear();
+}
+
+void rsm_epoch_domain::reclaimer_loop()
+{
+    std::unique_lock<std::mutex> _lock(_mutex);
+    while (!_stopping)
+    {
+        _reclaimer_gate.wait_for(_lock, std::chrono::milliseconds(RSM_EPOCH_RECLAIM_INTERVAL_MS),
+            [this] { return _stopping || _retired.size() >= RSM_EPOCH_RECLAIM_BATCH; });
+        if (_stopping)
+        {
+            break;
+        }
+        if (!_retired.empty())
+        {
+            _lock.unlock();
+            reclaim();
+            _lock.lock();
+        }
+    }
+}
+
+void rsm_epoch_domain::lock_shared()
+{
+    rsm_epoch_record *record = record_for_this_thread();
+    if (record->nesting++ != 0)
+    {
+        return;
+    }
+    // an epoch that is already out of date only makes us look older than we are, which is safe
+    record->epoch.store(_epoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+    // our epoch has to be visible before we read any pointer, see oldest_active_epoch()
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void rsm_epoch_domain::unlock_shared()
+{
+    rsm_epoch_record *record = rsm_epoch_this_thread.find(_id);
+    if (record == nullptr || record->nesting == 0)
+    {
+        if (rsm_default_policies::debug_assertions)
+        {
+            throw std::logic_error("unlock_shared called on a thread that is not in a read section");
+        }
+        return;
+    }
+    if (--record->nesting == 0)
+    {
+        record->epoch.store(0, std::memory_order_release);
+    }
+}
+
+void rsm_epoch_domain::retire(void *ptr, void (*deleter)(void *))
+{
+    // readers that enter after this see the new epoch and can no longer find ptr
+    const uint64_t epoch = _epoch.fetch_add(1);
+    bool reclaim_now = false;
+    {
+        std::lock_guard<std::mutex> _lock(_mutex);
+        _retired.push_back({ptr, deleter, epoch});
+        if (_retired.size() >= RSM_EPOCH_RECLAIM_BATCH)
+        {
+            if (_background)
+            {
+                _reclaimer_gate.notify_one();
+            }
+            else
+            {
+                reclaim_now = true;
+            }
+        }
+        if (_background && !_reclaimer.joinable())
+        {
+            _reclaimer = std::thread(&rsm_epoch_domain::reclaimer_loop, this);
+        }
+    }
+    if (reclaim_now)
+    {
+        reclaim();
+    }
+}
+
+size_t rsm_epoch_domain::reclaim()
+{
+    std::vector<retired_object> reclaimable;
+    {
+        std::lock_guard<std::mutex> _lock(_mutex);
+        const uint64_t oldest = oldest_active_epoch();
+        // an object retired in an epoch older than every active reader's can not be seen by any of them
+        auto first_kept = std::partition(_retired.begin(), _retired.end(),
+            [oldest](const retired_object &object) { return object.epoch < oldest; });
+        reclaimable.assign(_retired.begin(), first_kept);
+        _retired.erase(_retired.begin(), first_kept);
+    }
+    const size_t freed = reclaimable.size();
+    free_retired(reclaimable);
+    return freed;
+}
+
+void rsm_epoch_domain::synchronize()
+{
+    rsm_epoch_record *record = rsm_epoch_this_thread.find(_id);
+    if (rsm_default_policies::debug_assertions && record != nullptr && record->nesting != 0)
+    {
+        throw std::logic_error("synchronize can not be called from inside a read section");
+    }
+    const uint64_t epoch = _epoch.fetch_add(1);
+    while (true)
+    {
+        {
+            std::lock_guard<std::mutex> _lock(_mutex);
+            if (oldest_active_epoch() > epoch)
+            {
+                break;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    reclaim();
+}
+
+size_t rsm_epoch_domain::pending()
+{
+    std::lock_guard<std::mutex> _lock(_mutex);
+    return _retired.size();
+}
@@ -0,0 +1,115 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifdef RSM_USE_FUTEX
+
+#include "include/rsm_futex.h"
+
+#include <cerrno>
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static long futex(std::atomic<uint32_t> *word,
+    const int &op,
+    const uint32_t &val,
+    const struct timespec *timeout = nullptr,
+    std::atomic<uint32_t> *word2 = nullptr,
+    const uint32_t &val3 = 0)
+{
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex words must be plain 32 bit integers");
+    return syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), op | FUTEX_PRIVATE_FLAG, val, timeout,
+        reinterpret_cast<uint32_t *>(word2), val3);
+}
+
+////////////////////////
+///
+/// rsm_futex_mutex
+///
+
+void rsm_futex_mutex::lock_contended()
+{
+    // once we had to wait we can not know if others are waiting too, so always leave the word at 2
+    while (_word.exchange(2, std::memory_order_acquire) != 0)
+    {
+        futex(&_word, FUTEX_WAIT, 2);
+    }
+}
+
+void rsm_futex_mutex::wake_one() { futex(&_word, FUTEX_WAKE, 1); }
+
+////////////////////////
+///
+/// rsm_futex_condition
+///
+
+void rsm_futex_condition::wait(std::unique_lock<rsm_futex_mutex> &lock)
+{
+    rsm_futex_mutex *mutex = lock.mutex();
+    _mutex = mutex;
+    const uint32_t sequence = _sequence.load(std::memory_order_relaxed);
+    _waiters++;
+    mutex->unlock();
+    // returns right away if a notify changed _sequence after we unlocked
+    futex(&_sequence, FUTEX_WAIT, sequence);
+    // we might have been requeued onto the mutex word so others may be sleeping there too
+    mutex->lock_contended();
+    _waiters--;
+}
+
+std::cv_status rsm_futex_condition::wait_until(std::unique_lock<rsm_futex_mutex> &lock,
+    const std::chrono::steady_clock::time_point &deadline)
+{
+    const auto remaining = deadline - std::chrono::steady_clock::now();
+    if (remaining <= std::chrono::steady_clock::duration::zero())
+    {
+        return std::cv_status::timeout;
+    }
+    const auto remaining_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(remaining).count();
+    struct timespec timeout;
+    timeout.tv_sec = remaining_ns / 1000000000;
+    timeout.tv_nsec = remaining_ns % 1000000000;
+
+    rsm_futex_mutex *mutex = lock.mutex();
+    _mutex = mutex;
+    const uint32_t sequence = _sequence.load(std::memory_order_relaxed);
+    _waiters++;
+    mutex->unlock();
+    // FUTEX_WAIT timeouts are relative and measured against CLOCK_MONOTONIC, the same clock as steady_clock
+    const bool timed_out = futex(&_sequence, FUTEX_WAIT, sequence, &timeout) == -1 && errno == ETIMEDOUT;
+    mutex->lock_contended();
+    _waiters--;
+    return timed_out ? std::cv_status::timeout : std::cv_status::no_timeout;
+}
+
+void rsm_futex_condition::notify_one()
+{
+    if (_waiters == 0)
+    {
+        return;
+    }
+    _sequence.fetch_add(1, std::memory_order_relaxed);
+    futex(&_sequence, FUTEX_WAKE, 1);
+}
+
+void rsm_futex_condition::notify_all()
+{
+    if (_waiters == 0)
+    {
+        return;
+    }
+    // the requeued waiters are only woken by unlock() if it sees the word marked as contended
+    _mutex->_word.store(2, std::memory_order_relaxed);
+    const uint32_t sequence = _sequence.fetch_add(1, std::memory_order_relaxed) + 1;
+    // only fails with EAGAIN if _sequence changed, which can not happen while we hold the mutex
+    while (futex(&_sequence, FUTEX_CMP_REQUEUE, 1, reinterpret_cast<const struct timespec *>(INT_MAX),
+               &_mutex->_word, sequence) == -1 &&
+           errno == EAGAIN)
+    {
+    }
+}
+
+#endif // RSM_USE_FUTEX
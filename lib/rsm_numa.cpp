@@ -0,0 +1,115 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "include/rsm_numa.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+static thread_local int rsm_numa_thread_node = -1;
+
+// the numbers in a sysfs list like 0-3,8-11
+static std::vector<size_t> parse_list(const std::string &ranges)
+{
+    std::vector<size_t> numbers;
+    std::stringstream stream(ranges);
+    std::string range;
+    while (std::getline(stream, range, ','))
+    {
+        if (range.empty())
+        {
+            continue;
+        }
+        const size_t dash = range.find('-');
+        const size_t first = std::strtoul(range.c_str(), nullptr, 10);
+        const size_t last = (dash == std::string::npos) ? first : std::strtoul(range.c_str() + dash + 1, nullptr, 10);
+        for (size_t number = first; number <= last; ++number)
+        {
+            numbers.push_back(number);
+        }
+    }
+    return numbers;
+}
+
+static std::string read_line(const std::string &path)
+{
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+
+// the node of every cpu, indexed by cpu number
+struct rsm_numa_topology
+{
+    std::vector<size_t> cpu_nodes;
+    size_t nodes;
+
+    rsm_numa_topology() : nodes(1)
+    {
+        const size_t cpus = std::max(1u, std::thread::hardware_concurrency());
+        const char *fake_nodes = std::getenv("RSM_NUMA_NODES");
+        if (fake_nodes != nullptr && std::atoi(fake_nodes) > 0)
+        {
+            nodes = static_cast<size_t>(std::atoi(fake_nodes));
+            for (size_t cpu = 0; cpu < cpus; ++cpu)
+            {
+                cpu_nodes.push_back(cpu * nodes / cpus);
+            }
+            return;
+        }
+        // node numbers can have gaps when nodes are offline or hot plugged, only this list has all of them
+        const std::vector<size_t> online = parse_list(read_line("/sys/devices/system/node/online"));
+        for (const size_t &node : online)
+        {
+            const std::string path = "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+            for (const size_t &cpu : parse_list(read_line(path)))
+            {
+                if (cpu_nodes.size() <= cpu)
+                {
+                    cpu_nodes.resize(cpu + 1, 0);
+                }
+                cpu_nodes[cpu] = node;
+            }
+        }
+        nodes = std::max<size_t>(1, online.size());
+    }
+};
+
+static const rsm_numa_topology &topology()
+{
+    static const rsm_numa_topology instance;
+    return instance;
+}
+
+size_t rsm_numa_node_count() { return topology().nodes; }
+
+size_t rsm_numa_current_node()
+{
+    if (rsm_numa_thread_node >= 0)
+    {
+        return static_cast<size_t>(rsm_numa_thread_node) % RSM_NUMA_MAX_NODES;
+    }
+#ifdef __linux__
+    const int cpu = sched_getcpu();
+    const rsm_numa_topology &machine = topology();
+    if (cpu >= 0 && static_cast<size_t>(cpu) < machine.cpu_nodes.size())
+    {
+        return machine.cpu_nodes[cpu] % RSM_NUMA_MAX_NODES;
+    }
+#endif
+    return 0;
+}
+
+void rsm_numa_set_thread_node(int node) { rsm_numa_thread_node = node; }
@@ -0,0 +1,90 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "include/rsm_parking_lot.h"
+
+static rsm_parking_bucket rsm_parking_lot[RSM_PARKING_LOT_BUCKETS];
+
+rsm_parking_bucket &rsm_parking_bucket_for(const void *address)
+{
+    // fibonacci hashing, the low bits of an address carry little information
+    const uint64_t key = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(address));
+    return rsm_parking_lot[((key * UINT64_C(0x9E3779B97F4A7C15)) >> 32) & (RSM_PARKING_LOT_BUCKETS - 1)];
+}
+
+void rsm_parking_bucket::push(rsm_parked_thread *parked)
+{
+    if (tail == nullptr)
+    {
+        head = parked;
+    }
+    else
+    {
+        tail->next = parked;
+    }
+    tail = parked;
+}
+
+uint32_t rsm_parking_bucket::parked_kinds(const void *address) const
+{
+    uint32_t kinds = 0;
+    for (rsm_parked_thread *parked = head; parked != nullptr; parked = parked->next)
+    {
+        if (parked->address == address)
+        {
+            kinds |= parked->kind;
+        }
+    }
+    return kinds;
+}
+
+size_t rsm_parking_bucket::parked_count(const void *address, const uint32_t &kinds) const
+{
+    size_t count = 0;
+    for (rsm_parked_thread *parked = head; parked != nullptr; parked = parked->next)
+    {
+        if (parked->address == address && (parked->kind & kinds) != 0)
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+size_t rsm_parking_bucket::unpark(const void *address, const uint32_t &kinds, const size_t &max)
+{
+    size_t woken = 0;
+    rsm_parked_thread *previous = nullptr;
+    rsm_parked_thread *parked = head;
+    while (parked != nullptr && woken < max)
+    {
+        rsm_parked_thread *next = parked->next;
+        if (parked->address != address || (parked->kind & kinds) == 0)
+        {
+            previous = parked;
+            parked = next;
+            continue;
+        }
+        if (previous == nullptr)
+        {
+            head = next;
+        }
+        else
+        {
+            previous->next = next;
+        }
+        if (tail == parked)
+        {
+            tail = previous;
+        }
+        // the parked thread may return and pop its node off the stack as soon as we unlock the bucket,
+        // which is after this, so the node is still there to notify
+        parked->unparked = true;
+        parked->gate.notify_one();
+        woken++;
+        parked = next;
+    }
+    return woken;
+}
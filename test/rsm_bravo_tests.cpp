@@ -0,0 +1,166 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rsm_bravo.h"
+#include "test_cxx_rsm.h"
+#include "timer.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(rsm_bravo_tests, TestSetup)
+
+// every test case uses its own lock, a revocation that had to wait for readers turns the bias off for a while
+std::vector<int> rsm_guarded_vector;
+
+void try_lock_fail(rsm_bravo<> *bravo) { BOOST_CHECK_EQUAL(bravo->try_lock(), false); }
+void try_lock_pass(rsm_bravo<> *bravo)
+{
+    BOOST_CHECK_EQUAL(bravo->try_lock(), true);
+    bravo->unlock();
+}
+
+void biased_reader(rsm_bravo<> *bravo, int value)
+{
+    bravo->lock_shared();
+    MilliSleep(200);
+    rsm_guarded_vector.push_back(value);
+    bravo->unlock_shared();
+}
+
+// readers that published themselves in the table keep writers out, a writer revokes the bias
+BOOST_AUTO_TEST_CASE(rsm_bravo_revocation)
+{
+    rsm_bravo<> bravo;
+    rsm_guarded_vector.clear();
+    BOOST_CHECK(bravo.read_biased());
+    std::thread one(biased_reader, &bravo, 1);
+    MilliSleep(50);
+    std::thread two(try_lock_fail, &bravo);
+    two.join();
+    BOOST_CHECK(bravo.read_biased());
+    bravo.lock();
+    BOOST_CHECK(!bravo.read_biased());
+    rsm_guarded_vector.push_back(2);
+    bravo.unlock();
+    one.join();
+
+    BOOST_CHECK_EQUAL(rsm_guarded_vector.size(), 2);
+    BOOST_CHECK_EQUAL(rsm_guarded_vector[0], 1);
+    BOOST_CHECK_EQUAL(rsm_guarded_vector[1], 2);
+}
+
+// a read section in the table becomes shared ownership of the mutex before promotion
+BOOST_AUTO_TEST_CASE(rsm_bravo_promotion)
+{
+    rsm_bravo<> bravo;
+    rsm_guarded_vector.clear();
+    BOOST_CHECK(bravo.read_biased());
+    bravo.lock_shared();
+    bravo.lock_shared();
+    std::thread one(biased_reader, &bravo, 1);
+    MilliSleep(50);
+    BOOST_CHECK_EQUAL(bravo.try_promotion(), true);
+    rsm_guarded_vector.push_back(2);
+    bravo.unlock();
+    // back to shared ownership
+    std::thread two(try_lock_fail, &bravo);
+    two.join();
+    bravo.unlock_shared();
+    bravo.unlock_shared();
+    one.join();
+    std::thread three(try_lock_pass, &bravo);
+    three.join();
+
+    BOOST_CHECK_EQUAL(rsm_guarded_vector.size(), 2);
+    BOOST_CHECK_EQUAL(rsm_guarded_vector[0], 1);
+    BOOST_CHECK_EQUAL(rsm_guarded_vector[1], 2);
+}
+
+// recursion works the same for readers in the table and through the mutex
+BOOST_AUTO_TEST_CASE(rsm_bravo_recursion)
+{
+    rsm_bravo<> bravo;
+    bravo.lock_shared();
+    bravo.lock_shared();
+    BOOST_CHECK_EQUAL(bravo.try_lock_shared(), true);
+    bravo.unlock_shared();
+    bravo.unlock_shared();
+    std::thread one(try_lock_fail, &bravo);
+    one.join();
+    bravo.unlock_shared();
+
+    bravo.lock();
+    bravo.lock();
+    bravo.lock_shared();
+    bravo.unlock();
+    bravo.unlock();
+    // the shared lock of the exclusive owner still keeps exclusive ownership
+    std::thread two(try_lock_fail, &bravo);
+    two.join();
+    // and it must not turn the bias back on
+    MilliSleep(10);
+    bravo.lock_shared();
+    BOOST_CHECK(!bravo.read_biased());
+    bravo.unlock_shared();
+    bravo.unlock_shared();
+    std::thread three(try_lock_pass, &bravo);
+    three.join();
+}
+
+// a reader going through the mutex turns the bias back on once the cool down after a revocation is over
+BOOST_AUTO_TEST_CASE(rsm_bravo_cool_down)
+{
+    rsm_bravo<> local;
+    local.lock();
+    BOOST_CHECK(!local.read_biased());
+    local.unlock();
+    MilliSleep(10);
+    local.lock_shared();
+    local.unlock_shared();
+    BOOST_CHECK(local.read_biased());
+}
+
+rsm_bravo<> bravo;
+int first = 0;
+int second = 0;
+std::atomic<int> bad(0);
+
+void bravo_worker(int rounds, int write_every)
+{
+    for (int i = 0; i < rounds; i++)
+    {
+        if (i % write_every == 0)
+        {
+            bravo.lock();
+            first++;
+            second++;
+            bravo.unlock();
+        }
+        else
+        {
+            bravo.lock_shared();
+            if (first != second)
+            {
+                bad++;
+            }
+            bravo.unlock_shared();
+        }
+    }
+}
+
+// readers never see a writer's section half done, whether they use the table or the mutex
+BOOST_AUTO_TEST_CASE(rsm_bravo_readers_and_writers)
+{
+    std::thread one(bravo_worker, 20000, 5);
+    std::thread two(bravo_worker, 20000, 100);
+    std::thread three(bravo_worker, 20000, 1000);
+    one.join();
+    two.join();
+    three.join();
+    BOOST_CHECK_EQUAL(bad, 0);
+    BOOST_CHECK_EQUAL(first, 4000 + 200 + 20);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,196 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rsm_compact.h"
+#include "test_cxx_rsm.h"
+#include "timer.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(rsm_compact_tests, TestSetup)
+
+BOOST_AUTO_TEST_CASE(rsm_compact_size)
+{
+    BOOST_CHECK_EQUAL(sizeof(rsm_compact_mutex), sizeof(uint64_t));
+}
+
+// recursion is tracked per thread, other threads still see the mutex as owned
+BOOST_AUTO_TEST_CASE(rsm_compact_recursion)
+{
+    rsm_compact_mutex mutex;
+    mutex.lock();
+    mutex.lock();
+    mutex.lock_shared();
+    BOOST_CHECK_EQUAL(mutex.try_lock(), true);
+    std::thread other([&mutex] {
+        BOOST_CHECK_EQUAL(mutex.try_lock(), false);
+        BOOST_CHECK_EQUAL(mutex.try_lock_shared(), false);
+    });
+    other.join();
+    mutex.unlock();
+    mutex.unlock();
+    mutex.unlock();
+    // the shared lock taken with exclusive ownership keeps it
+    std::thread still_owned([&mutex] { BOOST_CHECK_EQUAL(mutex.try_lock_shared(), false); });
+    still_owned.join();
+    mutex.unlock_shared();
+
+    mutex.lock_shared();
+    mutex.lock_shared();
+    std::thread reader([&mutex] {
+        BOOST_CHECK_EQUAL(mutex.try_lock_shared(), true);
+        BOOST_CHECK_EQUAL(mutex.try_lock(), false);
+        mutex.unlock_shared();
+    });
+    reader.join();
+    mutex.unlock_shared();
+    mutex.unlock_shared();
+    BOOST_CHECK_EQUAL(mutex.try_lock(), true);
+    mutex.unlock();
+#ifdef RSM_DEBUG_ASSERTION
+    BOOST_CHECK_THROW(mutex.unlock(), std::logic_error);
+    BOOST_CHECK_THROW(mutex.unlock_shared(), std::logic_error);
+#endif
+}
+
+// a promoted thread waits for the other readers and keeps its shared ownership when it unlocks
+BOOST_AUTO_TEST_CASE(rsm_compact_promotion)
+{
+    rsm_compact_mutex mutex;
+    std::atomic<bool> reader_done(false);
+    mutex.lock_shared();
+    std::thread reader([&mutex, &reader_done] {
+        mutex.lock_shared();
+        MilliSleep(100);
+        reader_done = true;
+        mutex.unlock_shared();
+    });
+    MilliSleep(20);
+    BOOST_CHECK_EQUAL(mutex.try_promotion(), true);
+    BOOST_CHECK_EQUAL(reader_done.load(), true);
+    mutex.lock_shared();
+    mutex.unlock();
+    std::thread writer([&mutex] { BOOST_CHECK_EQUAL(mutex.try_lock(), false); });
+    writer.join();
+    mutex.unlock_shared();
+    mutex.unlock_shared();
+    reader.join();
+
+    // only one thread can wait for promotion
+    std::atomic<bool> promoted(false);
+    mutex.lock_shared();
+    std::thread candidate([&mutex, &promoted] {
+        mutex.lock_shared();
+        BOOST_CHECK_EQUAL(mutex.try_promotion(), true);
+        promoted = true;
+        mutex.unlock();
+        mutex.unlock_shared();
+    });
+    MilliSleep(50);
+    BOOST_CHECK_EQUAL(mutex.try_promotion(), false);
+    BOOST_CHECK_EQUAL(promoted.load(), false);
+    mutex.unlock_shared();
+    candidate.join();
+    BOOST_CHECK_EQUAL(promoted.load(), true);
+}
+
+// parked readers go before the writer that parked after them, a waiting writer blocks new readers
+BOOST_AUTO_TEST_CASE(rsm_compact_parking)
+{
+    rsm_compact_mutex mutex;
+    std::mutex order_mutex;
+    std::string order;
+    auto record = [&order_mutex, &order](char who) {
+        std::lock_guard<std::mutex> lock(order_mutex);
+        order.push_back(who);
+    };
+    mutex.lock();
+    std::thread reader([&mutex, &record] {
+        mutex.lock_shared();
+        record('r');
+        MilliSleep(50);
+        mutex.unlock_shared();
+    });
+    MilliSleep(30);
+    std::thread writer([&mutex, &record] {
+        mutex.lock();
+        record('w');
+        mutex.unlock();
+    });
+    MilliSleep(30);
+    mutex.unlock();
+    MilliSleep(20);
+    // the writer is parked now, new readers wait behind it
+    BOOST_CHECK_EQUAL(mutex.try_lock_shared(), false);
+    reader.join();
+    writer.join();
+    BOOST_CHECK_EQUAL(order, "rw");
+}
+
+// many instances share the parking lot, every thread still gets through
+BOOST_AUTO_TEST_CASE(rsm_compact_stress)
+{
+    std::vector<rsm_compact_mutex> mutexes(4);
+    std::vector<uint64_t> first(4, 0);
+    std::vector<uint64_t> second(4, 0);
+    std::atomic<uint64_t> torn(0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 8; ++i)
+    {
+        threads.emplace_back([&mutexes, &first, &second, &torn, i] {
+            for (int j = 0; j < 5000; ++j)
+            {
+                const size_t index = (i + j) % mutexes.size();
+                rsm_compact_mutex &mutex = mutexes[index];
+                if (j % 4 == 0)
+                {
+                    mutex.lock();
+                    first[index]++;
+                    second[index]++;
+                    mutex.unlock();
+                }
+                else if (j % 4 == 1)
+                {
+                    mutex.lock_shared();
+                    if (mutex.try_promotion())
+                    {
+                        first[index]++;
+                        second[index]++;
+                        mutex.unlock();
+                    }
+                    mutex.unlock_shared();
+                }
+                else
+                {
+                    mutex.lock_shared();
+                    mutex.lock_shared();
+                    if (first[index] != second[index])
+                    {
+                        torn++;
+                    }
+                    mutex.unlock_shared();
+                    mutex.unlock_shared();
+                }
+            }
+        });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    BOOST_CHECK_EQUAL(torn.load(), 0);
+    for (size_t i = 0; i < first.size(); ++i)
+    {
+        BOOST_CHECK_EQUAL(first[i], second[i]);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
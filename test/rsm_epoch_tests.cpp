@@ -0,0 +1,157 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "recursive_shared_mutex.h"
+#include "rsm_epoch.h"
+#include "test_cxx_rsm.h"
+#include "timer.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(rsm_epoch_tests, TestSetup)
+
+std::atomic<int> freed(0);
+
+struct node
+{
+    int value;
+    // set by the deleter instead of freeing so a reader that still sees the node can notice
+    std::atomic<bool> dead;
+
+    node(int v) : value(v), dead(false) {}
+};
+
+// the background thread and synchronize() can both be reclaiming
+std::mutex graveyard_mutex;
+std::vector<node *> graveyard;
+
+void count_free(void *) { freed++; }
+void bury(void *object)
+{
+    static_cast<node *>(object)->dead = true;
+    std::lock_guard<std::mutex> lock(graveyard_mutex);
+    graveyard.push_back(static_cast<node *>(object));
+}
+
+void read_section(rsm_epoch_domain *domain, int ms)
+{
+    domain->lock_shared();
+    MilliSleep(ms);
+    domain->unlock_shared();
+}
+
+// an object is only freed once the readers that were in a read section when it was retired have left
+BOOST_AUTO_TEST_CASE(rsm_epoch_deferred_free)
+{
+    freed = 0;
+    rsm_epoch_domain domain(false);
+    int object = 0;
+    domain.lock_shared();
+    domain.retire(&object, count_free);
+    BOOST_CHECK_EQUAL(domain.reclaim(), 0);
+    // nested sections keep the epoch of the outermost one
+    domain.lock_shared();
+    domain.unlock_shared();
+    BOOST_CHECK_EQUAL(domain.reclaim(), 0);
+    domain.unlock_shared();
+    BOOST_CHECK_EQUAL(domain.reclaim(), 1);
+    BOOST_CHECK_EQUAL(freed, 1);
+
+    // a reader that entered after the object was retired can not have seen it
+    domain.retire(&object, count_free);
+    domain.lock_shared();
+    BOOST_CHECK_EQUAL(domain.reclaim(), 1);
+    domain.unlock_shared();
+    BOOST_CHECK_EQUAL(domain.pending(), 0);
+}
+
+// reader threads block reclamation until they leave, synchronize() waits for them
+BOOST_AUTO_TEST_CASE(rsm_epoch_synchronize)
+{
+    freed = 0;
+    rsm_epoch_domain domain(false);
+    int object = 0;
+    std::thread one(read_section, &domain, 200);
+    MilliSleep(50);
+    domain.retire(&object, count_free);
+    BOOST_CHECK_EQUAL(domain.reclaim(), 0);
+    domain.synchronize();
+    BOOST_CHECK_EQUAL(freed, 1);
+    one.join();
+}
+
+// without a background thread retire() frees a batch itself, with one the background thread does
+BOOST_AUTO_TEST_CASE(rsm_epoch_batches)
+{
+    freed = 0;
+    int object = 0;
+    {
+        rsm_epoch_domain domain(false);
+        for (int i = 0; i < RSM_EPOCH_RECLAIM_BATCH; i++)
+        {
+            domain.retire(&object, count_free);
+        }
+        BOOST_CHECK_EQUAL(freed, RSM_EPOCH_RECLAIM_BATCH);
+    }
+    freed = 0;
+    {
+        rsm_epoch_domain domain;
+        domain.retire(&object, count_free);
+        MilliSleep(RSM_EPOCH_RECLAIM_INTERVAL_MS * 20);
+        BOOST_CHECK_EQUAL(freed, 1);
+        domain.retire(&object, count_free);
+    }
+    // the destructor frees what is left
+    BOOST_CHECK_EQUAL(freed, 2);
+}
+
+rsm_epoch_domain epochs;
+recursive_shared_mutex rsm;
+std::atomic<node *> head(nullptr);
+
+void epoch_reader(int rounds)
+{
+    for (int i = 0; i < rounds; i++)
+    {
+        std::shared_lock<rsm_epoch_domain> section(epochs);
+        node *current = head.load(std::memory_order_acquire);
+        BOOST_REQUIRE(current != nullptr);
+        BOOST_REQUIRE(!current->dead);
+    }
+}
+
+void epoch_writer(int rounds)
+{
+    for (int i = 0; i < rounds; i++)
+    {
+        rsm.lock();
+        node *old = head.exchange(new node(i), std::memory_order_acq_rel);
+        epochs.retire(old, bury);
+        rsm.unlock();
+    }
+}
+
+// readers never see a node that has been freed
+BOOST_AUTO_TEST_CASE(rsm_epoch_readers_and_writers)
+{
+    head = new node(-1);
+    std::thread one(epoch_writer, 5000);
+    std::thread two(epoch_reader, 20000);
+    std::thread three(epoch_reader, 20000);
+    one.join();
+    two.join();
+    three.join();
+    epochs.synchronize();
+    BOOST_CHECK_EQUAL(epochs.pending(), 0);
+    BOOST_CHECK_EQUAL(graveyard.size(), 5000);
+    for (node *dead : graveyard)
+    {
+        delete dead;
+    }
+    graveyard.clear();
+    delete head.exchange(nullptr);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,104 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "recursive_shared_mutex.h"
+#include "test_cxx_rsm.h"
+#include "timer.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(rsm_fairness_tests, TestSetup)
+
+std::mutex order_mutex;
+std::vector<char> order;
+
+void record(char who)
+{
+    std::lock_guard<std::mutex> lock(order_mutex);
+    order.push_back(who);
+}
+
+/*
+ * While the main thread has exclusive ownership two writers and then a reader start waiting.
+ * The order in which they get ownership once the main thread unlocks depends on the policy.
+ */
+template <class Mutex>
+std::string ownership_order()
+{
+    Mutex mutex;
+    order.clear();
+    mutex.lock();
+    std::thread one([&mutex] {
+        mutex.lock();
+        record('w');
+        MilliSleep(20);
+        mutex.unlock();
+    });
+    MilliSleep(50);
+    std::thread two([&mutex] {
+        mutex.lock();
+        record('W');
+        MilliSleep(20);
+        mutex.unlock();
+    });
+    MilliSleep(50);
+    std::thread three([&mutex] {
+        mutex.lock_shared();
+        record('r');
+        MilliSleep(20);
+        mutex.unlock_shared();
+    });
+    MilliSleep(50);
+    mutex.unlock();
+    one.join();
+    two.join();
+    three.join();
+    return std::string(order.begin(), order.end());
+}
+
+BOOST_AUTO_TEST_CASE(rsm_fairness_ownership_order)
+{
+    // the reader that was waiting goes between the writers
+    BOOST_CHECK_EQUAL(ownership_order<recursive_shared_mutex>(), "wrW");
+    BOOST_CHECK_EQUAL(ownership_order<phase_fair_recursive_shared_mutex>(), "wrW");
+    // the reader goes first
+    BOOST_CHECK_EQUAL(ownership_order<reader_preferring_recursive_shared_mutex>(), "rwW");
+    // the reader waits for every queued writer
+    BOOST_CHECK_EQUAL(ownership_order<writer_preferring_recursive_shared_mutex>(), "wWr");
+}
+
+// new readers are only let past a waiting writer by the reader_preferring policy
+template <class Mutex>
+bool reader_passes_waiting_writer()
+{
+    Mutex mutex;
+    mutex.lock_shared();
+    std::thread writer([&mutex] {
+        mutex.lock();
+        mutex.unlock();
+    });
+    MilliSleep(50);
+    bool passed = false;
+    std::thread reader([&mutex, &passed] {
+        passed = mutex.try_lock_shared();
+        if (passed)
+        {
+            mutex.unlock_shared();
+        }
+    });
+    reader.join();
+    mutex.unlock_shared();
+    writer.join();
+    return passed;
+}
+
+BOOST_AUTO_TEST_CASE(rsm_fairness_reader_passes_waiting_writer)
+{
+    BOOST_CHECK_EQUAL(reader_passes_waiting_writer<phase_fair_recursive_shared_mutex>(), false);
+    BOOST_CHECK_EQUAL(reader_passes_waiting_writer<reader_preferring_recursive_shared_mutex>(), true);
+    BOOST_CHECK_EQUAL(reader_passes_waiting_writer<writer_preferring_recursive_shared_mutex>(), false);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
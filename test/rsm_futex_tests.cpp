@@ -0,0 +1,80 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifdef RSM_USE_FUTEX
+
+#include "rsm_futex.h"
+#include "test_cxx_rsm.h"
+#include "timer.h"
+
+#include <thread>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(rsm_futex_tests, TestSetup)
+
+rsm_futex_mutex futex_mutex;
+rsm_futex_condition futex_condition;
+bool futex_gate_open = false;
+int futex_woken = 0;
+int futex_guarded_counter = 0;
+
+void futex_waiter()
+{
+    std::unique_lock<rsm_futex_mutex> lock(futex_mutex);
+    futex_condition.wait(lock, [] { return futex_gate_open; });
+    futex_woken++;
+}
+
+void futex_incrementer()
+{
+    for (int i = 0; i < 100000; ++i)
+    {
+        std::lock_guard<rsm_futex_mutex> lock(futex_mutex);
+        futex_guarded_counter++;
+    }
+}
+
+// the futex mutex provides mutual exclusion
+BOOST_AUTO_TEST_CASE(rsm_futex_mutex_exclusion)
+{
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i)
+    {
+        threads.emplace_back(futex_incrementer);
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    BOOST_CHECK_EQUAL(futex_guarded_counter, 400000);
+}
+
+// notify_all requeues the waiters onto the mutex, every one of them must still wake up
+BOOST_AUTO_TEST_CASE(rsm_futex_condition_notify_all)
+{
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 8; ++i)
+    {
+        threads.emplace_back(futex_waiter);
+    }
+    // give the waiters time to go to sleep
+    MilliSleep(250);
+    {
+        std::lock_guard<rsm_futex_mutex> lock(futex_mutex);
+        futex_gate_open = true;
+        futex_condition.notify_all();
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    BOOST_CHECK_EQUAL(futex_woken, 8);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+#endif // RSM_USE_FUTEX
@@ -0,0 +1,198 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rsm_compact.h"
+#include "rsm_guarded.h"
+#include "test_cxx_rsm.h"
+#include "timer.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(rsm_guarded_tests, TestSetup)
+
+BOOST_AUTO_TEST_CASE(rsm_guarded_read_write)
+{
+    rsm_guarded<std::vector<int> > guarded(3, 7);
+    BOOST_CHECK_EQUAL(guarded.read([](const std::vector<int> &values) { return values.size(); }), 3);
+    guarded.write([](std::vector<int> &values) { values.push_back(8); });
+    BOOST_CHECK_EQUAL(guarded.read([](const std::vector<int> &values) { return values.back(); }), 8);
+    BOOST_CHECK_EQUAL(guarded.writes(), 1);
+
+    // ownership ends when fn throws
+    BOOST_CHECK_THROW(guarded.write([](std::vector<int> &) -> int { throw std::runtime_error("fn failed"); }),
+        std::runtime_error);
+    std::thread other([&guarded] {
+        BOOST_CHECK_EQUAL(guarded.write([](std::vector<int> &values) { return values.size(); }), 4);
+    });
+    other.join();
+
+    // a reader can read again and write from inside a write
+    guarded.write([&guarded](std::vector<int> &values) {
+        values.push_back(guarded.read([](const std::vector<int> &inner) { return int(inner.size()); }));
+    });
+    BOOST_CHECK_EQUAL(guarded.read([](const std::vector<int> &values) { return values.back(); }), 4);
+}
+
+BOOST_AUTO_TEST_CASE(rsm_guarded_read_then_promote)
+{
+    rsm_guarded<int> guarded(1);
+    // no write, nothing is counted
+    const bool wrote = guarded.read_then_promote([](rsm_guarded<int>::promotable &value) {
+        BOOST_CHECK_EQUAL(value.promoted(), false);
+        return value.get() > 5;
+    });
+    BOOST_CHECK_EQUAL(wrote, false);
+    BOOST_CHECK_EQUAL(guarded.writes(), 0);
+
+    guarded.read_then_promote([](rsm_guarded<int>::promotable &value) {
+        if (value.get() < 5)
+        {
+            value.promote() = 5;
+            BOOST_CHECK_EQUAL(value.changed(), false);
+            BOOST_CHECK_EQUAL(value.promoted(), true);
+        }
+    });
+    BOOST_CHECK_EQUAL(guarded.read([](const int &value) { return value; }), 5);
+    BOOST_CHECK_EQUAL(guarded.writes(), 1);
+
+    // ownership is released, another thread can write
+    std::thread other([&guarded] { guarded.write([](int &value) { value++; }); });
+    other.join();
+    BOOST_CHECK_EQUAL(guarded.read([](const int &value) { return value; }), 6);
+}
+
+// every thread adds one if the value is even, the ones promoted after another writer see changed()
+template <class Mutex>
+void check_promotion_race()
+{
+    rsm_guarded<uint64_t, Mutex> guarded(0);
+    std::atomic<uint64_t> increments(0);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 6; ++t)
+    {
+        threads.emplace_back([&guarded, &increments] {
+            for (int i = 0; i < 2000; ++i)
+            {
+                guarded.read_then_promote([&increments](typename rsm_guarded<uint64_t, Mutex>::promotable &value) {
+                    if (value.get() % 2 != 0)
+                    {
+                        return;
+                    }
+                    uint64_t &writable = value.promote();
+                    if (value.changed() && writable % 2 != 0)
+                    {
+                        return;
+                    }
+                    writable++;
+                    increments++;
+                });
+                guarded.write([](uint64_t &value) {
+                    if (value % 2 != 0)
+                    {
+                        value++;
+                    }
+                });
+            }
+        });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    BOOST_CHECK_EQUAL(guarded.read([](const uint64_t &value) { return value; }), 2 * increments.load());
+}
+
+BOOST_AUTO_TEST_CASE(rsm_guarded_promotion_race)
+{
+    check_promotion_race<recursive_shared_mutex>();
+    check_promotion_race<rsm_compact_mutex>();
+}
+
+BOOST_AUTO_TEST_CASE(rsm_guarded_snapshot)
+{
+    rsm_guarded<std::vector<int> > guarded(2, 1);
+    std::shared_ptr<const std::vector<int> > first = guarded.snapshot();
+    BOOST_CHECK_EQUAL(first->size(), 2);
+    // the same copy until a write
+    BOOST_CHECK(guarded.snapshot() == first);
+    guarded.read([](const std::vector<int> &) { return 0; });
+    BOOST_CHECK(guarded.snapshot() == first);
+
+    guarded.write([](std::vector<int> &values) { values.push_back(2); });
+    std::shared_ptr<const std::vector<int> > second = guarded.snapshot();
+    BOOST_CHECK(second != first);
+    BOOST_CHECK_EQUAL(second->size(), 3);
+    // the old copy is left as it was
+    BOOST_CHECK_EQUAL(first->size(), 2);
+
+    // a reader holding a current copy does not wait for a writer
+    std::atomic<bool> writing(false);
+    std::atomic<bool> done(false);
+    std::thread writer([&guarded, &writing, &done] {
+        guarded.write([&writing, &done](std::vector<int> &values) {
+            writing = true;
+            while (!done)
+            {
+                MilliSleep(1);
+            }
+            values.clear();
+        });
+    });
+    while (!writing)
+    {
+        MilliSleep(1);
+    }
+    BOOST_CHECK(guarded.snapshot() == second);
+    done = true;
+    writer.join();
+    BOOST_CHECK_EQUAL(guarded.snapshot()->size(), 0);
+}
+
+// snapshots taken while writers run are always whole copies
+BOOST_AUTO_TEST_CASE(rsm_guarded_snapshot_stress)
+{
+    rsm_guarded<std::vector<uint64_t> > guarded(16, 0);
+    std::atomic<uint64_t> torn(0);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 6; ++t)
+    {
+        threads.emplace_back([&guarded, &torn, t] {
+            for (uint64_t i = 0; i < 5000; ++i)
+            {
+                if ((i + t) % 50 == 0)
+                {
+                    guarded.write([&i](std::vector<uint64_t> &values) {
+                        for (auto &value : values)
+                        {
+                            value = i;
+                        }
+                    });
+                }
+                else
+                {
+                    std::shared_ptr<const std::vector<uint64_t> > snapshot = guarded.snapshot();
+                    for (const auto &value : *snapshot)
+                    {
+                        if (value != snapshot->front())
+                        {
+                            torn++;
+                        }
+                    }
+                }
+            }
+        });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    BOOST_CHECK_EQUAL(torn.load(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
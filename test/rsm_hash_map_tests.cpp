@@ -0,0 +1,272 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rsm_compact.h"
+#include "rsm_hash_map.h"
+#include "test_cxx_rsm.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(rsm_hash_map_tests, TestSetup)
+
+BOOST_AUTO_TEST_CASE(rsm_hash_map_basics)
+{
+    rsm_hash_map<std::string, int> map(4);
+    int value = 0;
+    BOOST_CHECK_EQUAL(map.find("one", value), false);
+    BOOST_CHECK_EQUAL(map.insert_or_assign("one", 1), true);
+    BOOST_CHECK_EQUAL(map.insert_or_assign("one", 11), false);
+    BOOST_CHECK_EQUAL(map.find("one", value), true);
+    BOOST_CHECK_EQUAL(value, 11);
+    BOOST_CHECK_EQUAL(map.find_or_insert("two", 2), 2);
+    BOOST_CHECK_EQUAL(map.find_or_insert("two", 22), 2);
+    BOOST_CHECK_EQUAL(map.contains("two"), true);
+    BOOST_CHECK_EQUAL(map.size(), 2);
+    BOOST_CHECK_EQUAL(map.erase("one"), true);
+    BOOST_CHECK_EQUAL(map.erase("one"), false);
+    BOOST_CHECK_EQUAL(map.contains("one"), false);
+    BOOST_CHECK_EQUAL(map.size(), 1);
+    map.clear();
+    BOOST_CHECK_EQUAL(map.size(), 0);
+    BOOST_CHECK_EQUAL(map.contains("two"), false);
+}
+
+// every stripe grows its own buckets, all entries are still found afterwards
+BOOST_AUTO_TEST_CASE(rsm_hash_map_growth)
+{
+    rsm_hash_map<uint64_t, uint64_t> map(8);
+    const size_t initial_buckets = map.bucket_count();
+    BOOST_CHECK_EQUAL(initial_buckets, 8 * RSM_HASH_MAP_INITIAL_BUCKETS);
+    for (uint64_t key = 0; key < 10000; ++key)
+    {
+        map.insert_or_assign(key, key * 3);
+    }
+    BOOST_CHECK_EQUAL(map.size(), 10000);
+    BOOST_CHECK(map.bucket_count() >= 10000);
+    uint64_t missing = 0;
+    for (uint64_t key = 0; key < 10000; ++key)
+    {
+        uint64_t value = 0;
+        if (!map.find(key, value) || value != key * 3)
+        {
+            missing++;
+        }
+    }
+    BOOST_CHECK_EQUAL(missing, 0);
+    for (uint64_t key = 0; key < 10000; key += 2)
+    {
+        map.erase(key);
+    }
+    BOOST_CHECK_EQUAL(map.size(), 5000);
+    BOOST_CHECK_EQUAL(map.contains(4), false);
+    BOOST_CHECK_EQUAL(map.contains(5), true);
+}
+
+// threads racing to insert the same keys all get the value of whichever one won
+template <class Mutex>
+void check_find_or_insert_race()
+{
+    rsm_hash_map<uint64_t, uint64_t, std::hash<uint64_t>, Mutex> map(4);
+    const uint64_t keys = 2000;
+    std::vector<std::vector<uint64_t> > seen(6, std::vector<uint64_t>(keys));
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < seen.size(); ++t)
+    {
+        threads.emplace_back([&map, &seen, &keys, t] {
+            for (uint64_t key = 0; key < keys; ++key)
+            {
+                seen[t][key] = map.find_or_insert(key, t);
+            }
+        });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    BOOST_CHECK_EQUAL(map.size(), keys);
+    uint64_t disagreements = 0;
+    for (uint64_t key = 0; key < keys; ++key)
+    {
+        uint64_t value = 0;
+        map.find(key, value);
+        for (size_t t = 0; t < seen.size(); ++t)
+        {
+            if (seen[t][key] != value)
+            {
+                disagreements++;
+            }
+        }
+    }
+    BOOST_CHECK_EQUAL(disagreements, 0);
+}
+
+BOOST_AUTO_TEST_CASE(rsm_hash_map_find_or_insert_race)
+{
+    check_find_or_insert_race<recursive_shared_mutex>();
+    check_find_or_insert_race<rsm_compact_mutex>();
+}
+
+// a value whose copies throw while fail is set
+struct throwing_value
+{
+    static std::atomic<bool> fail;
+    int value;
+
+    throwing_value(int _value = 0) : value(_value) {}
+    throwing_value(const throwing_value &other) : value(other.value) { check(); }
+    throwing_value &operator=(const throwing_value &other)
+    {
+        check();
+        value = other.value;
+        return *this;
+    }
+
+    static void check()
+    {
+        if (fail)
+        {
+            throw std::runtime_error("copy failed");
+        }
+    }
+};
+
+std::atomic<bool> throwing_value::fail(false);
+
+// a copy that throws under shared, promoted or exclusive ownership leaves the stripe usable
+template <class Mutex>
+void check_throwing_copy()
+{
+    rsm_hash_map<int, throwing_value, std::hash<int>, Mutex> map(1);
+    throwing_value value(1);
+    throwing_value::fail = true;
+    // a miss throws while promoted, a hit while shared
+    BOOST_CHECK_THROW(map.find_or_insert(1, value), std::runtime_error);
+    BOOST_CHECK_THROW(map.insert_or_assign(1, value), std::runtime_error);
+    throwing_value::fail = false;
+    BOOST_CHECK_EQUAL(map.size(), 0);
+    map.insert_or_assign(2, value);
+    throwing_value::fail = true;
+    BOOST_CHECK_THROW(map.find_or_insert(2, value), std::runtime_error);
+    BOOST_CHECK_THROW(map.insert_or_assign(2, value), std::runtime_error);
+    throwing_value found;
+    BOOST_CHECK_THROW(map.find(2, found), std::runtime_error);
+    throwing_value::fail = false;
+
+    // no ownership was left behind, another thread can write and read the stripe
+    std::thread other([&map] {
+        BOOST_CHECK_EQUAL(map.insert_or_assign(3, throwing_value(3)), true);
+        throwing_value inner;
+        BOOST_CHECK_EQUAL(map.find(2, inner), true);
+        BOOST_CHECK_EQUAL(inner.value, 1);
+    });
+    other.join();
+    BOOST_CHECK_EQUAL(map.find_or_insert(1, throwing_value(4)).value, 4);
+    BOOST_CHECK_EQUAL(map.size(), 3);
+}
+
+BOOST_AUTO_TEST_CASE(rsm_hash_map_throwing_copy)
+{
+    check_throwing_copy<recursive_shared_mutex>();
+    check_throwing_copy<rsm_compact_mutex>();
+}
+
+// a key whose copies throw while fail is set
+struct throwing_key
+{
+    static std::atomic<bool> fail;
+    int key;
+
+    throwing_key(int _key = 0) : key(_key) {}
+    throwing_key(const throwing_key &other) : key(other.key)
+    {
+        if (fail)
+        {
+            throw std::runtime_error("copy failed");
+        }
+    }
+    bool operator==(const throwing_key &other) const { return key == other.key; }
+};
+
+std::atomic<bool> throwing_key::fail(false);
+
+struct throwing_key_hash
+{
+    size_t operator()(const throwing_key &key) const { return std::hash<int>()(key.key); }
+};
+
+// a key copy that throws while a miss is inserted leaves the stripe free for lock_all_stripes()
+template <class Mutex>
+void check_throwing_key()
+{
+    rsm_hash_map<throwing_key, int, throwing_key_hash, Mutex> map(2);
+    throwing_key::fail = true;
+    BOOST_CHECK_THROW(map.find_or_insert(throwing_key(1), 1), std::runtime_error);
+    BOOST_CHECK_THROW(map.insert_or_assign(throwing_key(2), 2), std::runtime_error);
+    throwing_key::fail = false;
+
+    // every stripe can be locked again by another thread
+    std::thread other([&map] {
+        map.clear();
+        BOOST_CHECK_EQUAL(map.insert_or_assign(throwing_key(1), 1), true);
+    });
+    other.join();
+    BOOST_CHECK_EQUAL(map.find_or_insert(throwing_key(1), 5), 1);
+    BOOST_CHECK_EQUAL(map.size(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(rsm_hash_map_throwing_key)
+{
+    check_throwing_key<recursive_shared_mutex>();
+    check_throwing_key<rsm_compact_mutex>();
+}
+
+// readers never see a value that was not written for their key while writers insert, grow and erase
+BOOST_AUTO_TEST_CASE(rsm_hash_map_stress)
+{
+    rsm_hash_map<uint64_t, uint64_t> map(4);
+    std::atomic<uint64_t> wrong(0);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 6; ++t)
+    {
+        threads.emplace_back([&map, &wrong, t] {
+            for (uint64_t i = 0; i < 20000; ++i)
+            {
+                const uint64_t key = (i * 31 + t * 7) % 3000;
+                if (i % 10 == 0)
+                {
+                    map.insert_or_assign(key, key + 1);
+                }
+                else if (i % 25 == 0)
+                {
+                    map.erase(key);
+                }
+                else
+                {
+                    uint64_t value = 0;
+                    if (map.find(key, value) && value != key + 1)
+                    {
+                        wrong++;
+                    }
+                    if (map.find_or_insert(key + 3000, key + 3001) != key + 3001)
+                    {
+                        wrong++;
+                    }
+                }
+            }
+        });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    BOOST_CHECK_EQUAL(wrong.load(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,249 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "recursive_shared_mutex.h"
+#include "rsm_lock_all.h"
+#include "rsm_padded.h"
+#include "test_cxx_rsm.h"
+#include "timer.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <thread>
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(rsm_lock_all_tests, TestSetup)
+
+// check from another thread which ownership the calling thread holds
+static void check_owned(recursive_shared_mutex &mutex, const bool &shared_free, const bool &exclusive_free)
+{
+    std::thread other([&mutex, &shared_free, &exclusive_free] {
+        const bool shared = mutex.try_lock_shared();
+        if (shared)
+        {
+            mutex.unlock_shared();
+        }
+        const bool exclusive = mutex.try_lock();
+        if (exclusive)
+        {
+            mutex.unlock();
+        }
+        BOOST_CHECK_EQUAL(shared, shared_free);
+        BOOST_CHECK_EQUAL(exclusive, exclusive_free);
+    });
+    other.join();
+}
+
+BOOST_AUTO_TEST_CASE(rsm_lock_all_mixed_modes)
+{
+    recursive_shared_mutex a;
+    recursive_shared_mutex b;
+    BOOST_CHECK_EQUAL(rsm_lock_all(rsm_shared(a), rsm_exclusive(b)), true);
+    check_owned(a, true, false);
+    check_owned(b, false, false);
+    rsm_unlock_all(rsm_shared(a), rsm_exclusive(b));
+    check_owned(a, true, true);
+    check_owned(b, true, true);
+
+    BOOST_CHECK_EQUAL(rsm_try_lock_all(rsm_exclusive(a), rsm_shared(b)), true);
+    check_owned(a, false, false);
+    check_owned(b, true, false);
+    rsm_unlock_all(rsm_exclusive(a), rsm_shared(b));
+    check_owned(a, true, true);
+    check_owned(b, true, true);
+}
+
+// a failed try_lock_all gives back what it already took
+BOOST_AUTO_TEST_CASE(rsm_lock_all_try_fails)
+{
+    recursive_shared_mutex a;
+    recursive_shared_mutex b;
+    std::atomic<bool> held(false);
+    std::atomic<bool> done(false);
+    std::thread owner([&b, &held, &done] {
+        b.lock();
+        held = true;
+        while (!done)
+        {
+            MilliSleep(1);
+        }
+        b.unlock();
+    });
+    while (!held)
+    {
+        MilliSleep(1);
+    }
+    BOOST_CHECK_EQUAL(rsm_try_lock_all(rsm_exclusive(a), rsm_shared(b)), false);
+    check_owned(a, true, true);
+    done = true;
+    owner.join();
+}
+
+// mutexes the thread already has ownership of recurse, an exclusive request on one it only reads is a promotion
+BOOST_AUTO_TEST_CASE(rsm_lock_all_already_owned)
+{
+    recursive_shared_mutex a;
+    recursive_shared_mutex b;
+    a.lock_shared();
+    b.lock();
+    BOOST_CHECK_EQUAL(rsm_lock_all(rsm_exclusive(a), rsm_shared(b), rsm_exclusive(b)), true);
+    BOOST_CHECK_EQUAL(a.has_shared_ownership(), true);
+    check_owned(a, false, false);
+    rsm_unlock_all(rsm_exclusive(a), rsm_shared(b), rsm_exclusive(b));
+    // back to the ownership from before the call
+    check_owned(a, true, false);
+    check_owned(b, false, false);
+    b.unlock();
+    a.unlock_shared();
+    BOOST_CHECK_EQUAL(a.has_shared_ownership(), false);
+    BOOST_CHECK_EQUAL(b.has_shared_ownership(), false);
+    check_owned(a, true, true);
+    check_owned(b, true, true);
+
+    // the same mutex asked for twice in both modes
+    BOOST_CHECK_EQUAL(rsm_lock_all(rsm_shared(a), rsm_exclusive(a)), true);
+    check_owned(a, false, false);
+    rsm_unlock_all(rsm_shared(a), rsm_exclusive(a));
+    check_owned(a, true, true);
+}
+
+// a promotion refused because of an update owner leaves nothing taken
+BOOST_AUTO_TEST_CASE(rsm_lock_all_refused_promotion)
+{
+    recursive_shared_mutex a;
+    recursive_shared_mutex b;
+    std::atomic<bool> held(false);
+    std::atomic<bool> done(false);
+    std::thread updater([&a, &held, &done] {
+        a.lock_update();
+        held = true;
+        while (!done)
+        {
+            MilliSleep(1);
+        }
+        a.unlock_update();
+    });
+    while (!held)
+    {
+        MilliSleep(1);
+    }
+    a.lock_shared();
+    BOOST_CHECK_EQUAL(rsm_lock_all(rsm_exclusive(b), rsm_exclusive(a)), false);
+    check_owned(b, true, true);
+    a.unlock_shared();
+    done = true;
+    updater.join();
+}
+
+// a promotion that is not possible right away fails without turning new readers away in the meantime
+BOOST_AUTO_TEST_CASE(rsm_lock_all_try_promotion_busy)
+{
+    recursive_shared_mutex a;
+    recursive_shared_mutex b;
+    std::atomic<bool> held(false);
+    std::atomic<bool> done(false);
+    std::atomic<uint64_t> turned_away(0);
+    std::thread reader([&a, &held, &done] {
+        a.lock_shared();
+        held = true;
+        while (!done)
+        {
+            MilliSleep(1);
+        }
+        a.unlock_shared();
+    });
+    while (!held)
+    {
+        MilliSleep(1);
+    }
+    std::thread newcomer([&a, &done, &turned_away] {
+        while (!done)
+        {
+            if (a.try_lock_shared())
+            {
+                a.unlock_shared();
+            }
+            else
+            {
+                turned_away++;
+            }
+        }
+    });
+    a.lock_shared();
+    for (int i = 0; i < 1000; ++i)
+    {
+        BOOST_CHECK_EQUAL(rsm_try_lock_all(rsm_exclusive(b), rsm_exclusive(a)), false);
+    }
+    check_owned(b, true, true);
+    a.unlock_shared();
+    done = true;
+    newcomer.join();
+    reader.join();
+    BOOST_CHECK_EQUAL(turned_away.load(), 0);
+}
+
+// transfers between accounts locked in every order and mode, nothing deadlocks and no money is lost
+BOOST_AUTO_TEST_CASE(rsm_lock_all_transfers)
+{
+    const size_t accounts = 6;
+    rsm_padded_array<recursive_shared_mutex> mutexes(accounts);
+    std::vector<int64_t> balances(accounts, 1000);
+    std::atomic<uint64_t> wrong_totals(0);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 6; ++t)
+    {
+        threads.emplace_back([&mutexes, &balances, &wrong_totals, &accounts, t] {
+            for (size_t i = 0; i < 3000; ++i)
+            {
+                const size_t from = (t + i) % accounts;
+                const size_t to = (t * 5 + i * 7 + 1) % accounts;
+                if (i % 4 == 0)
+                {
+                    // read every account at once, the total never changes
+                    std::vector<rsm_lock_request<recursive_shared_mutex> > requests;
+                    for (size_t k = 0; k < accounts; ++k)
+                    {
+                        requests.push_back(rsm_shared(mutexes[(k + t) % accounts]));
+                    }
+                    rsm_lock_all(requests.data(), requests.size());
+                    int64_t total = 0;
+                    for (const int64_t &balance : balances)
+                    {
+                        total += balance;
+                    }
+                    if (total != int64_t(1000 * accounts))
+                    {
+                        wrong_totals++;
+                    }
+                    rsm_unlock_all(requests.data(), requests.size());
+                }
+                else if (from != to)
+                {
+                    // a reader of a third account makes the lock orders of the threads overlap more
+                    const size_t other = (from + to) % accounts;
+                    rsm_lock_request<recursive_shared_mutex> requests[] = {
+                        rsm_exclusive(mutexes[to]), rsm_shared(mutexes[other]), rsm_exclusive(mutexes[from])};
+                    rsm_lock_all(requests, 3);
+                    balances[from] -= 3;
+                    balances[to] += 3;
+                    rsm_unlock_all(requests, 3);
+                }
+            }
+        });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    BOOST_CHECK_EQUAL(wrong_totals.load(), 0);
+    int64_t total = 0;
+    for (const int64_t &balance : balances)
+    {
+        total += balance;
+    }
+    BOOST_CHECK_EQUAL(total, int64_t(1000 * accounts));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
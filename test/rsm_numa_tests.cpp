@@ -0,0 +1,260 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "recursive_shared_mutex.h"
+#include "rsm_numa.h"
+#include "test_cxx_rsm.h"
+#include "timer.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(rsm_numa_tests, TestSetup)
+
+std::mutex numa_order_mutex;
+std::string numa_order;
+
+void numa_record(char who)
+{
+    std::lock_guard<std::mutex> lock(numa_order_mutex);
+    numa_order.push_back(who);
+}
+
+BOOST_AUTO_TEST_CASE(rsm_numa_thread_node)
+{
+    BOOST_CHECK(rsm_numa_node_count() >= 1);
+    BOOST_CHECK(rsm_numa_current_node() < RSM_NUMA_MAX_NODES);
+    rsm_numa_set_thread_node(3);
+    BOOST_CHECK_EQUAL(rsm_numa_current_node(), 3);
+    rsm_numa_set_thread_node(RSM_NUMA_MAX_NODES + 1);
+    BOOST_CHECK_EQUAL(rsm_numa_current_node(), 1);
+    std::thread other([] { BOOST_CHECK(rsm_numa_current_node() < RSM_NUMA_MAX_NODES); });
+    other.join();
+    rsm_numa_set_thread_node(-1);
+}
+
+/*
+ * The main thread has exclusive ownership on node 0 while writers a (node 1), b (node 0), c (node 1)
+ * and d (node 0) queue up in that order.
+ */
+template <class Mutex>
+std::string writer_order()
+{
+    Mutex mutex;
+    numa_order.clear();
+    rsm_numa_set_thread_node(0);
+    mutex.lock();
+    std::vector<std::thread> writers;
+    const std::string names = "abcd";
+    const int nodes[] = {1, 0, 1, 0};
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        writers.emplace_back([&mutex, &names, &nodes, i] {
+            rsm_numa_set_thread_node(nodes[i]);
+            mutex.lock();
+            numa_record(names[i]);
+            MilliSleep(10);
+            mutex.unlock();
+        });
+        MilliSleep(30);
+    }
+    mutex.unlock();
+    for (auto &writer : writers)
+    {
+        writer.join();
+    }
+    rsm_numa_set_thread_node(-1);
+    return numa_order;
+}
+
+BOOST_AUTO_TEST_CASE(rsm_numa_writer_order)
+{
+    // first in first out
+    BOOST_CHECK_EQUAL(writer_order<recursive_shared_mutex>(), "abcd");
+    // node 0 keeps ownership as long as it has waiters
+    BOOST_CHECK_EQUAL(writer_order<numa_recursive_shared_mutex>(), "bdac");
+    // one local hand-off, then the longest waiting thread on the other node
+    BOOST_CHECK_EQUAL(writer_order<rsm_cohort_mutex<1> >(), "bacd");
+}
+
+/*
+ * The main thread has exclusive ownership on node 0 while writer A (node 1) and writer B (node 0) queue
+ * up, then reader x (node 0) and reader y (node 1) park.
+ */
+template <class Mutex>
+std::string batch_order()
+{
+    Mutex mutex;
+    numa_order.clear();
+    rsm_numa_set_thread_node(0);
+    mutex.lock();
+    std::vector<std::thread> threads;
+    const std::string names = "ABxy";
+    const int nodes[] = {1, 0, 0, 1};
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        threads.emplace_back([&mutex, &names, &nodes, i] {
+            rsm_numa_set_thread_node(nodes[i]);
+            if (i < 2)
+            {
+                mutex.lock();
+                numa_record(names[i]);
+                MilliSleep(20);
+                mutex.unlock();
+            }
+            else
+            {
+                mutex.lock_shared();
+                numa_record(names[i]);
+                MilliSleep(20);
+                mutex.unlock_shared();
+            }
+        });
+        MilliSleep(30);
+    }
+    mutex.unlock();
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    rsm_numa_set_thread_node(-1);
+    return numa_order;
+}
+
+BOOST_AUTO_TEST_CASE(rsm_numa_reader_batches)
+{
+    // A is next, then both readers as one batch
+    std::string order = batch_order<recursive_shared_mutex>();
+    BOOST_CHECK(order == "AxyB" || order == "AyxB");
+    // B stays on node 0, then only the node 0 reader goes before A. y is admitted once nobody is waiting
+    BOOST_CHECK_EQUAL(batch_order<numa_recursive_shared_mutex>(), "BxAy");
+}
+
+/*
+ * The main thread on node 0 gets its first exclusive ownership through promotion while writer a (node 1)
+ * and writer b (node 0) queue up in that order.
+ */
+BOOST_AUTO_TEST_CASE(rsm_numa_promotion_handoff)
+{
+    numa_recursive_shared_mutex mutex;
+    numa_order.clear();
+    rsm_numa_set_thread_node(0);
+    mutex.lock_shared();
+    BOOST_CHECK(mutex.try_promotion());
+    std::vector<std::thread> writers;
+    const std::string names = "ab";
+    const int nodes[] = {1, 0};
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        writers.emplace_back([&mutex, &names, &nodes, i] {
+            rsm_numa_set_thread_node(nodes[i]);
+            mutex.lock();
+            numa_record(names[i]);
+            MilliSleep(10);
+            mutex.unlock();
+        });
+        MilliSleep(30);
+    }
+    mutex.unlock();
+    mutex.unlock_shared();
+    for (auto &writer : writers)
+    {
+        writer.join();
+    }
+    rsm_numa_set_thread_node(-1);
+    // the promotion made node 0 the cohort node, so b goes first
+    BOOST_CHECK_EQUAL(numa_order, "ba");
+}
+
+/*
+ * The main thread on node 0 gets its first exclusive ownership through promotion while writer W (node 1)
+ * queues up and reader x (node 0) and reader y (node 1) park, then it downgrades.
+ */
+BOOST_AUTO_TEST_CASE(rsm_numa_promotion_downgrade)
+{
+    numa_recursive_shared_mutex mutex;
+    numa_order.clear();
+    rsm_numa_set_thread_node(0);
+    mutex.lock_shared();
+    BOOST_CHECK(mutex.try_promotion());
+    std::vector<std::thread> threads;
+    const std::string names = "Wxy";
+    const int nodes[] = {1, 0, 1};
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        threads.emplace_back([&mutex, &names, &nodes, i] {
+            rsm_numa_set_thread_node(nodes[i]);
+            if (i == 0)
+            {
+                mutex.lock();
+                numa_record(names[i]);
+                MilliSleep(20);
+                mutex.unlock();
+            }
+            else
+            {
+                mutex.lock_shared();
+                numa_record(names[i]);
+                MilliSleep(20);
+                mutex.unlock_shared();
+            }
+        });
+        MilliSleep(30);
+    }
+    // the promotion made node 0 the cohort node, so only x joins us before W
+    mutex.downgrade();
+    MilliSleep(30);
+    // the promoted shared lock and the downgraded exclusive one
+    mutex.unlock_shared();
+    mutex.unlock_shared();
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    rsm_numa_set_thread_node(-1);
+    BOOST_CHECK_EQUAL(numa_order, "xWy");
+}
+
+// ownership still ends up with every waiting thread when the nodes keep changing
+BOOST_AUTO_TEST_CASE(rsm_numa_stress)
+{
+    rsm_cohort_mutex<2> mutex;
+    uint64_t first = 0;
+    uint64_t second = 0;
+    std::atomic<uint64_t> torn(0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 6; ++i)
+    {
+        threads.emplace_back([&mutex, &first, &second, &torn, i] {
+            for (int j = 0; j < 3000; ++j)
+            {
+                rsm_numa_set_thread_node((i + j) % 3);
+                if (i % 2 == 0)
+                {
+                    mutex.lock();
+                    first++;
+                    second++;
+                    mutex.unlock();
+                }
+                else
+                {
+                    mutex.lock_shared();
+                    if (first != second)
+                    {
+                        torn++;
+                    }
+                    mutex.unlock_shared();
+                }
+            }
+        });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    BOOST_CHECK_EQUAL(torn.load(), 0);
+    BOOST_CHECK_EQUAL(first, 9000);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
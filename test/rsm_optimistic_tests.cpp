@@ -0,0 +1,112 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "recursive_shared_mutex.h"
+#include "test_cxx_rsm.h"
+#include "timer.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(rsm_optimistic_tests, TestSetup)
+
+recursive_shared_mutex rsm;
+// written with exclusive ownership, always equal when read consistently
+std::atomic<int> first(0);
+std::atomic<int> second(0);
+
+void lock_and_unlock()
+{
+    rsm.lock();
+    rsm.unlock();
+}
+
+// a read validates unless exclusive ownership was held at some point since read_begin()
+BOOST_AUTO_TEST_CASE(rsm_read_validate)
+{
+    uint64_t version = rsm.read_begin();
+    BOOST_CHECK_EQUAL(rsm.read_validate(version), true);
+    // shared ownership does not invalidate optimistic reads
+    rsm.lock_shared();
+    BOOST_CHECK_EQUAL(rsm.read_validate(version), true);
+    rsm.unlock_shared();
+
+    std::thread one(lock_and_unlock);
+    one.join();
+    BOOST_CHECK_EQUAL(rsm.read_validate(version), false);
+
+    // a writer that is still in its section
+    version = rsm.read_begin();
+    rsm.lock();
+    BOOST_CHECK_EQUAL(rsm.read_validate(version), false);
+    version = rsm.read_begin();
+    BOOST_CHECK_EQUAL(rsm.read_validate(version), false);
+    rsm.unlock();
+
+    // promotions are writers too
+    version = rsm.read_begin();
+    rsm.lock_shared();
+    BOOST_CHECK_EQUAL(rsm.try_promotion(), true);
+    rsm.unlock();
+    rsm.unlock_shared();
+    BOOST_CHECK_EQUAL(rsm.read_validate(version), false);
+}
+
+// falls back to shared ownership once the optimistic attempts are used up
+BOOST_AUTO_TEST_CASE(rsm_optimistic_read_fallback)
+{
+    int reads = 0;
+    auto read = [&reads] {
+        reads++;
+        return first.load(std::memory_order_relaxed);
+    };
+    BOOST_CHECK_EQUAL(rsm.optimistic_read(read), 0);
+    BOOST_CHECK_EQUAL(reads, 1);
+
+    // our own exclusive ownership fails every optimistic attempt, the shared lock is recursive
+    reads = 0;
+    rsm.lock();
+    first.store(1, std::memory_order_relaxed);
+    BOOST_CHECK_EQUAL(rsm.optimistic_read(read, 3), 1);
+    BOOST_CHECK_EQUAL(reads, 4);
+    first.store(0, std::memory_order_relaxed);
+    rsm.unlock();
+}
+
+void writer(int rounds)
+{
+    for (int i = 1; i <= rounds; i++)
+    {
+        rsm.lock();
+        first.store(i, std::memory_order_relaxed);
+        second.store(i, std::memory_order_relaxed);
+        rsm.unlock();
+    }
+}
+
+void optimistic_reader(int rounds)
+{
+    for (int i = 0; i < rounds; i++)
+    {
+        std::pair<int, int> values = rsm.optimistic_read([] {
+            return std::make_pair(first.load(std::memory_order_relaxed), second.load(std::memory_order_relaxed));
+        });
+        BOOST_REQUIRE_EQUAL(values.first, values.second);
+    }
+}
+
+// a validated read never sees half of a write
+BOOST_AUTO_TEST_CASE(rsm_optimistic_read_consistent)
+{
+    std::thread one(writer, 20000);
+    std::thread two(optimistic_reader, 20000);
+    std::thread three(optimistic_reader, 20000);
+    one.join();
+    two.join();
+    three.join();
+    first = 0;
+    second = 0;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
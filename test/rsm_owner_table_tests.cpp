@@ -0,0 +1,86 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rsm_owner_table.h"
+#include "test_cxx_rsm.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(rsm_owner_table_tests, TestSetup)
+
+// keys only need to be distinct addresses, use an array of cache line sized objects
+// so the keys look like mutex addresses
+struct fake_mutex
+{
+    char padding[64];
+};
+fake_mutex fake_mutexes[64];
+
+// basic insert, find and erase tests
+BOOST_AUTO_TEST_CASE(rsm_owner_table_insert_find_erase)
+{
+    rsm_owner_table<16> table;
+    BOOST_CHECK(table.find(&fake_mutexes[0]) == nullptr);
+
+    table.get_or_insert(&fake_mutexes[0]) = 3;
+    table.get_or_insert(&fake_mutexes[1]) = 5;
+    BOOST_CHECK_EQUAL(table.size(), 2);
+    BOOST_CHECK_EQUAL(*table.find(&fake_mutexes[0]), 3);
+    BOOST_CHECK_EQUAL(*table.find(&fake_mutexes[1]), 5);
+
+    // get_or_insert of an existing key must not reset the count
+    table.get_or_insert(&fake_mutexes[0])++;
+    BOOST_CHECK_EQUAL(*table.find(&fake_mutexes[0]), 4);
+
+    table.erase(&fake_mutexes[0]);
+    BOOST_CHECK(table.find(&fake_mutexes[0]) == nullptr);
+    BOOST_CHECK_EQUAL(*table.find(&fake_mutexes[1]), 5);
+    BOOST_CHECK_EQUAL(table.size(), 1);
+
+    // erasing a key that is not in the table does nothing
+    table.erase(&fake_mutexes[0]);
+    BOOST_CHECK_EQUAL(table.size(), 1);
+}
+
+// fill past the inline capacity so keys go to the overflow table, then erase
+// in an order that forces entries to be shifted back over erased slots
+BOOST_AUTO_TEST_CASE(rsm_owner_table_overflow)
+{
+    rsm_owner_table<8> table;
+    for (uint64_t i = 0; i < 64; ++i)
+    {
+        table.get_or_insert(&fake_mutexes[i]) = i + 1;
+    }
+    BOOST_CHECK_EQUAL(table.size(), 64);
+    for (uint64_t i = 0; i < 64; ++i)
+    {
+        BOOST_CHECK_EQUAL(*table.find(&fake_mutexes[i]), i + 1);
+    }
+
+    for (uint64_t i = 0; i < 64; i += 2)
+    {
+        table.erase(&fake_mutexes[i]);
+    }
+    BOOST_CHECK_EQUAL(table.size(), 32);
+    for (uint64_t i = 0; i < 64; ++i)
+    {
+        if (i % 2 == 0)
+        {
+            BOOST_CHECK(table.find(&fake_mutexes[i]) == nullptr);
+        }
+        else
+        {
+            BOOST_CHECK_EQUAL(*table.find(&fake_mutexes[i]), i + 1);
+        }
+    }
+
+    for (uint64_t i = 1; i < 64; i += 2)
+    {
+        table.erase(&fake_mutexes[i]);
+    }
+    BOOST_CHECK_EQUAL(table.size(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,154 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "recursive_shared_mutex.h"
+#include "rsm_compact.h"
+#include "rsm_padded.h"
+#include "test_cxx_rsm.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstddef>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(rsm_padded_tests, TestSetup)
+
+// exposes where the groups of members start and end
+template <class Mutex>
+class layout_of : public Mutex
+{
+public:
+    size_t offset_of(const void *member) const
+    {
+        return reinterpret_cast<const char *>(member) - reinterpret_cast<const char *>(this);
+    }
+    size_t state_offset() const { return offset_of(&this->_state); }
+    size_t generation_end() const { return offset_of(&this->_write_generation) + sizeof(this->_write_generation); }
+    size_t mutex_offset() const { return offset_of(&this->_mutex); }
+    size_t owner_offset() const { return offset_of(&this->_write_owner_id); }
+    size_t owner_end() const { return owner_offset() + sizeof(this->_write_owner_id); }
+    size_t counter_end() const { return offset_of(&this->_write_counter) + sizeof(this->_write_counter); }
+    size_t hold_end() const { return offset_of(&this->_average_hold_ns) + sizeof(this->_average_hold_ns); }
+    size_t update_end() const { return offset_of(&this->_update_waiters) + sizeof(this->_update_waiters); }
+    size_t shards_offset() const { return offset_of(&this->_reader_shards); }
+    size_t shards_end() const { return shards_offset() + sizeof(this->_reader_shards); }
+    size_t cohort_offset() const { return offset_of(&this->_cohort_node); }
+    size_t cohort_end() const { return offset_of(&this->_node_reader_batch) + sizeof(this->_node_reader_batch); }
+};
+
+typedef layout_of<recursive_shared_mutex> layout_mutex;
+typedef layout_of<basic_recursive_shared_mutex<rsm_reader_shards<4>, rsm_numa_cohort<2> > > layout_sharded_mutex;
+
+BOOST_AUTO_TEST_CASE(rsm_padded_mutex_layout)
+{
+    // plain new and new[] before C++17 must give correctly aligned storage
+    BOOST_CHECK(alignof(recursive_shared_mutex) <= alignof(std::max_align_t));
+    layout_mutex mutex;
+    // a whole cache line between the state word readers write to and both the exclusive owner and _mutex,
+    // so they never share a line wherever the mutex starts
+    const size_t line = RSM_CACHE_LINE_SIZE;
+    BOOST_CHECK(mutex.state_offset() >= mutex.owner_end() + line);
+    BOOST_CHECK(mutex.state_offset() >= mutex.counter_end() + line);
+    BOOST_CHECK(mutex.state_offset() >= mutex.hold_end() + line);
+    BOOST_CHECK(mutex.mutex_offset() >= mutex.generation_end() + line);
+    // the promotion and update state is written by other threads than the exclusive owner
+    BOOST_CHECK(mutex.owner_offset() >= mutex.update_end() + line);
+}
+
+BOOST_AUTO_TEST_CASE(rsm_padded_sharded_mutex_layout)
+{
+    layout_sharded_mutex mutex;
+    const size_t line = RSM_CACHE_LINE_SIZE;
+    BOOST_CHECK_EQUAL(alignof(layout_sharded_mutex) % line, 0);
+    // every reader shard has whole cache lines of its own
+    BOOST_CHECK_EQUAL(mutex.shards_offset() % line, 0);
+    BOOST_CHECK_EQUAL(mutex.shards_end() % line, 0);
+    BOOST_CHECK(mutex.shards_offset() >= mutex.update_end() + line);
+    BOOST_CHECK(mutex.cohort_offset() >= mutex.shards_end());
+    BOOST_CHECK(mutex.owner_offset() >= mutex.cohort_end() + line);
+    BOOST_CHECK(mutex.state_offset() >= mutex.hold_end() + line);
+}
+
+// counts live instances so the tests can tell when elements are constructed and destroyed
+struct counted
+{
+    static int live;
+    int value;
+
+    explicit counted(const int &initial) : value(initial)
+    {
+        if (initial < 0)
+        {
+            throw std::runtime_error("negative");
+        }
+        live++;
+    }
+    ~counted() { live--; }
+};
+
+int counted::live = 0;
+
+BOOST_AUTO_TEST_CASE(rsm_padded_array_elements)
+{
+    {
+        rsm_padded_array<counted> values(5, 7);
+        BOOST_CHECK_EQUAL(values.size(), 5);
+        BOOST_CHECK_EQUAL(counted::live, 5);
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            BOOST_CHECK_EQUAL(values[i].value, 7);
+            // every element starts its own line
+            BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(&values[i]) % RSM_CACHE_LINE_SIZE, 0);
+        }
+    }
+    BOOST_CHECK_EQUAL(counted::live, 0);
+    // the elements constructed before the throw are destroyed again
+    BOOST_CHECK_THROW(rsm_padded_array<counted> values(3, -1), std::runtime_error);
+    BOOST_CHECK_EQUAL(counted::live, 0);
+
+    rsm_padded_array<rsm_compact_mutex> compact(4);
+    BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(&compact[1]) - reinterpret_cast<uintptr_t>(&compact[0]),
+        uintptr_t(RSM_CACHE_LINE_SIZE));
+    rsm_padded_array<recursive_shared_mutex> mutexes(4);
+    for (size_t i = 0; i < mutexes.size(); ++i)
+    {
+        BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(&mutexes[i]) % RSM_CACHE_LINE_SIZE, 0);
+    }
+}
+
+// neighbouring mutexes of a padded array are independent
+BOOST_AUTO_TEST_CASE(rsm_padded_array_mutexes)
+{
+    rsm_padded_array<recursive_shared_mutex> mutexes(4);
+    std::vector<std::thread> threads;
+    std::vector<uint64_t> counts(mutexes.size(), 0);
+    for (size_t i = 0; i < mutexes.size(); ++i)
+    {
+        threads.emplace_back([&mutexes, &counts, i] {
+            for (int j = 0; j < 10000; ++j)
+            {
+                mutexes[i].lock();
+                mutexes[i].lock_shared();
+                counts[i]++;
+                mutexes[i].unlock_shared();
+                mutexes[i].unlock();
+            }
+        });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    for (size_t i = 0; i < mutexes.size(); ++i)
+    {
+        BOOST_CHECK_EQUAL(counts[i], 10000);
+        BOOST_CHECK_EQUAL(mutexes[i].try_lock(), true);
+        mutexes[i].unlock();
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
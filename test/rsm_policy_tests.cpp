@@ -0,0 +1,137 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "recursive_shared_mutex.h"
+#include "test_cxx_rsm.h"
+#include "timer.h"
+
+#include <shared_mutex>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(rsm_policy_tests, TestSetup)
+
+typedef basic_recursive_shared_mutex<rsm_recursion<false>, rsm_promotion<false>, rsm_owner_tracking<false> >
+    plain_shared_mutex;
+typedef basic_recursive_shared_mutex<rsm_recursion<false> > non_recursive_mutex;
+typedef basic_recursive_shared_mutex<rsm_recursion<false>, rsm_debug_assertions<true> > checked_non_recursive_mutex;
+
+// turned off features do not take any space
+BOOST_AUTO_TEST_CASE(rsm_policy_sizes)
+{
+    BOOST_CHECK(sizeof(plain_shared_mutex) < sizeof(non_recursive_mutex));
+    BOOST_CHECK(sizeof(non_recursive_mutex) < sizeof(recursive_shared_mutex));
+    BOOST_CHECK(std::is_empty<rsm_owner_state<false> >::value);
+    BOOST_CHECK(std::is_empty<rsm_recursion_state<false> >::value);
+    BOOST_CHECK(std::is_empty<rsm_promotion_state<false> >::value);
+    BOOST_CHECK(std::is_empty<null_recursive_shared_mutex>::value);
+}
+
+// the policies do not change the order they are given in
+BOOST_AUTO_TEST_CASE(rsm_policy_selection)
+{
+    typedef rsm_policy_selector<rsm_promotion<false>, rsm_fairness_policy<rsm_fairness::writer_preferring> > one;
+    typedef rsm_policy_selector<rsm_fairness_policy<rsm_fairness::writer_preferring>, rsm_promotion<false> > two;
+    BOOST_CHECK_EQUAL(one::promotion, false);
+    BOOST_CHECK_EQUAL(two::promotion, false);
+    BOOST_CHECK(one::fairness == rsm_fairness::writer_preferring);
+    BOOST_CHECK(two::fairness == rsm_fairness::writer_preferring);
+    BOOST_CHECK_EQUAL(one::recursion, true);
+    BOOST_CHECK_EQUAL(rsm_policy_selector<>::owner_tracking, true);
+}
+
+plain_shared_mutex plain;
+
+void plain_shared_only()
+{
+    plain.lock_shared();
+    MilliSleep(100);
+    plain.unlock_shared();
+}
+
+void plain_try_lock_fail() { BOOST_CHECK_EQUAL(plain.try_lock(), false); }
+
+// without recursion every shared lock is its own shared owner
+BOOST_AUTO_TEST_CASE(rsm_policy_plain_shared_mutex)
+{
+    plain.lock();
+    BOOST_CHECK_EQUAL(plain.try_lock_shared(), false);
+    plain.unlock();
+
+    std::thread one(plain_shared_only);
+    std::thread two(plain_shared_only);
+    MilliSleep(50);
+    std::thread three(plain_try_lock_fail);
+    three.join();
+    // waits for threads one and two
+    plain.lock();
+    plain.unlock();
+    one.join();
+    two.join();
+
+    {
+        std::shared_lock<plain_shared_mutex> lock(plain);
+        BOOST_CHECK_EQUAL(plain.try_lock_shared(), true);
+        plain.unlock_shared();
+    }
+    BOOST_CHECK_EQUAL(plain.try_lock(), true);
+    plain.unlock();
+}
+
+non_recursive_mutex promotable;
+
+void promotable_shared_only()
+{
+    promotable.lock_shared();
+    MilliSleep(200);
+    promotable.unlock_shared();
+}
+
+// without recursion the promotion candidate must have shared ownership and keeps it after unlock()
+BOOST_AUTO_TEST_CASE(rsm_policy_non_recursive_promotion)
+{
+    std::thread one(promotable_shared_only);
+    MilliSleep(50);
+    promotable.lock_shared();
+    // blocks until thread one has released its shared lock
+    BOOST_CHECK_EQUAL(promotable.try_promotion(), true);
+    promotable.unlock();
+    one.join();
+    std::thread two([] { BOOST_CHECK_EQUAL(promotable.try_lock(), false); });
+    two.join();
+    promotable.unlock_shared();
+    BOOST_CHECK_EQUAL(promotable.try_lock(), true);
+    promotable.unlock();
+}
+
+// with owner tracking and debug assertions misuse throws whatever the build configuration is
+BOOST_AUTO_TEST_CASE(rsm_policy_debug_assertions)
+{
+    checked_non_recursive_mutex checked;
+    checked.lock();
+    BOOST_CHECK_THROW(checked.lock(), std::logic_error);
+    BOOST_CHECK_THROW(checked.lock_shared(), std::logic_error);
+    checked.unlock();
+    BOOST_CHECK_THROW(checked.unlock(), std::logic_error);
+    BOOST_CHECK_THROW(checked.unlock_shared(), std::logic_error);
+}
+
+// the null mutex works anywhere a shared mutex does
+BOOST_AUTO_TEST_CASE(rsm_policy_null_mutex)
+{
+    null_recursive_shared_mutex null;
+    {
+        std::lock_guard<null_recursive_shared_mutex> lock(null);
+        std::shared_lock<null_recursive_shared_mutex> shared_lock(null);
+        BOOST_CHECK_EQUAL(null.try_lock(), true);
+        null.unlock();
+    }
+    BOOST_CHECK_EQUAL(null.try_promotion(), true);
+    BOOST_CHECK_EQUAL(null.try_lock_for(std::chrono::milliseconds(1)), true);
+    null.unlock();
+    null.unlock();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
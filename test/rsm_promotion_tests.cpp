@@ -129,4 +129,274 @@ BOOST_AUTO_TEST_CASE(rsm_try_promotion)
     rsm.unlock_shared();
 }
 
+void recursive_shared_only()
+{
+    rsm.lock_shared();
+    // give time for the main thread to ask for promotion
+    MilliSleep(500);
+    // we already have shared ownership so this must not be blocked by the pending promotion
+    rsm.lock_shared();
+    rsm.unlock_shared();
+    rsm.unlock_shared();
+}
+
+/*
+ * a thread that already has shared ownership can always lock_shared again, even
+ * while another thread is waiting for promotion and new shared owners are blocked
+ */
+
+BOOST_AUTO_TEST_CASE(rsm_recursive_shared_during_promotion)
+{
+    rsm_guarded_vector.clear();
+    rsm.lock_shared();
+    std::thread one(recursive_shared_only);
+    MilliSleep(250);
+    // blocks until thread one has released all of its shared locks
+    BOOST_CHECK_EQUAL(rsm.try_promotion(), true);
+    rsm_guarded_vector.push_back(7);
+    rsm.unlock();
+    rsm.unlock_shared();
+    one.join();
+
+    BOOST_CHECK_EQUAL(rsm_guarded_vector.size(), 1);
+}
+
+void promote_after_exclusive()
+{
+    // blocks until the main thread has released exclusive ownership
+    BOOST_CHECK_EQUAL(rsm.try_promotion_for(std::chrono::milliseconds(2000)), true);
+    rsm_guarded_vector.push_back(7);
+    rsm.unlock();
+}
+
+/*
+ * a thread can take the promotion slot while another thread has exclusive ownership
+ * through lock(), releasing that ownership must not end the waiting promotion
+ */
+
+BOOST_AUTO_TEST_CASE(rsm_promotion_while_exclusive)
+{
+    rsm_guarded_vector.clear();
+    rsm.lock();
+    std::thread one(promote_after_exclusive);
+    MilliSleep(250);
+    rsm_guarded_vector.push_back(4);
+    rsm.unlock();
+    one.join();
+
+    BOOST_CHECK_EQUAL(rsm_guarded_vector.size(), 2);
+    BOOST_CHECK_EQUAL(rsm.try_lock(), true);
+    rsm.unlock();
+}
+
+void exclusive_with_value(int value)
+{
+    rsm.lock();
+    rsm_guarded_vector.push_back(value);
+    rsm.unlock();
+}
+
+void shared_with_value(int value)
+{
+    rsm.lock_shared();
+    rsm_guarded_vector.push_back(value);
+    MilliSleep(100);
+    rsm.unlock_shared();
+}
+
+/*
+ * downgrade turns every exclusive and shared lock into a shared lock and lets in the
+ * readers that were waiting, the writer that was waiting first has to wait for all of them
+ */
+
+BOOST_AUTO_TEST_CASE(rsm_downgrade)
+{
+    rsm_guarded_vector.clear();
+    rsm.lock();
+    rsm.lock();
+    rsm.lock_shared();
+    std::thread one(exclusive_with_value, 4);
+    MilliSleep(50);
+    std::thread two(shared_with_value, 5);
+    MilliSleep(50);
+    rsm.downgrade();
+    // we still have shared ownership so the writer can not get in
+    MilliSleep(50);
+    std::thread three(helper_fail);
+    three.join();
+    rsm_guarded_vector.push_back(6);
+    rsm.unlock_shared();
+    rsm.unlock_shared();
+    rsm.unlock_shared();
+    one.join();
+    two.join();
+
+    rsm.lock_shared();
+    BOOST_CHECK_EQUAL(rsm_guarded_vector.size(), 3);
+    BOOST_CHECK_EQUAL(5, rsm_guarded_vector[0]);
+    BOOST_CHECK_EQUAL(6, rsm_guarded_vector[1]);
+    BOOST_CHECK_EQUAL(4, rsm_guarded_vector[2]);
+    rsm.unlock_shared();
+}
+
+// a promoted thread gets back its shared lock plus one for the exclusive lock
+BOOST_AUTO_TEST_CASE(rsm_downgrade_after_promotion)
+{
+    rsm.lock_shared();
+    BOOST_CHECK_EQUAL(rsm.try_promotion(), true);
+    rsm.downgrade();
+    std::thread one(helper_fail);
+    one.join();
+    // the promotion slot is free again so new readers are not blocked
+    std::thread two([] {
+        BOOST_CHECK_EQUAL(rsm.try_lock_shared(), true);
+        rsm.unlock_shared();
+    });
+    two.join();
+    rsm.unlock_shared();
+    rsm.unlock_shared();
+    std::thread three(helper_pass);
+    three.join();
+}
+
+void queued_promotion(int value, int delay)
+{
+    rsm.lock_shared();
+    MilliSleep(delay);
+    BOOST_CHECK_EQUAL(rsm.try_promotion(), true);
+    rsm_guarded_vector.push_back(value);
+    rsm.unlock();
+    rsm.unlock_shared();
+}
+
+void helper_shared_fail() { BOOST_CHECK_EQUAL(rsm.try_lock_shared(), false); }
+
+/*
+ * several shared owners can wait for promotion at the same time, they are promoted
+ * in the order they asked, all of them ahead of a thread that waits in lock() and
+ * new shared owners are blocked until the last of them is done
+ */
+
+BOOST_AUTO_TEST_CASE(rsm_queued_promotions)
+{
+    rsm_guarded_vector.clear();
+    // keep every candidate waiting until all of them are queued
+    rsm.lock_shared();
+    std::thread one(queued_promotion, 1, 100);
+    std::thread two(queued_promotion, 2, 200);
+    std::thread three(queued_promotion, 3, 300);
+    MilliSleep(150);
+    std::thread four(exclusive_with_value, 4);
+    MilliSleep(250);
+    std::thread five(helper_shared_fail);
+    five.join();
+    rsm.unlock_shared();
+    one.join();
+    two.join();
+    three.join();
+    four.join();
+
+    BOOST_CHECK_EQUAL(rsm_guarded_vector.size(), 4);
+    for (size_t i = 0; i < rsm_guarded_vector.size(); i++)
+    {
+        BOOST_CHECK_EQUAL(rsm_guarded_vector[i], i + 1);
+    }
+    BOOST_CHECK_EQUAL(rsm.try_lock_shared(), true);
+    rsm.unlock_shared();
+}
+
+// a queued candidate that gives up leaves the candidates behind it in line
+BOOST_AUTO_TEST_CASE(rsm_queued_promotion_timeout)
+{
+    rsm_guarded_vector.clear();
+    rsm.lock_shared();
+    std::thread one([] {
+        rsm.lock_shared();
+        MilliSleep(100);
+        BOOST_CHECK_EQUAL(rsm.try_promotion_for(std::chrono::milliseconds(100)), false);
+        rsm.unlock_shared();
+    });
+    std::thread two(queued_promotion, 2, 150);
+    MilliSleep(300);
+    rsm.unlock_shared();
+    one.join();
+    two.join();
+
+    BOOST_CHECK_EQUAL(rsm_guarded_vector.size(), 1);
+    std::thread three(helper_pass);
+    three.join();
+}
+
+// try_promotion_no_wait only succeeds for the only shared owner, and never waits in line
+BOOST_AUTO_TEST_CASE(rsm_try_promotion_no_wait)
+{
+    rsm.lock_shared();
+    BOOST_CHECK_EQUAL(rsm.try_promotion_no_wait(), true);
+    std::thread one(helper_fail);
+    one.join();
+    // recursive while we have exclusive ownership
+    BOOST_CHECK_EQUAL(rsm.try_promotion_no_wait(), true);
+    rsm.unlock();
+    rsm.unlock();
+
+    std::atomic<bool> held(false);
+    std::atomic<bool> done(false);
+    std::thread reader([&held, &done] {
+        rsm.lock_shared();
+        held = true;
+        while (!done)
+        {
+            MilliSleep(1);
+        }
+        rsm.unlock_shared();
+    });
+    while (!held)
+    {
+        MilliSleep(1);
+    }
+    BOOST_CHECK_EQUAL(rsm.try_promotion_no_wait(), false);
+    // nobody was turned away while it tried
+    std::thread two([] {
+        BOOST_CHECK_EQUAL(rsm.try_lock_shared(), true);
+        rsm.unlock_shared();
+    });
+    two.join();
+    done = true;
+    reader.join();
+    rsm.unlock_shared();
+    std::thread three(helper_pass);
+    three.join();
+}
+
+// the write generation tells a thread that lost a promotion if another writer ran before it got back in
+BOOST_AUTO_TEST_CASE(rsm_write_generation)
+{
+    rsm_guarded_vector.clear();
+    rsm.lock_shared();
+    uint64_t generation = rsm.write_generation();
+    rsm.unlock_shared();
+    rsm.lock();
+    BOOST_CHECK_EQUAL(rsm.written_since(generation), false);
+    // recursive and shared locks of the exclusive owner do not end exclusive ownership
+    rsm.lock();
+    rsm.lock_shared();
+    rsm.unlock_shared();
+    rsm.unlock();
+    BOOST_CHECK_EQUAL(rsm.written_since(generation), false);
+    rsm.unlock();
+    BOOST_CHECK_EQUAL(rsm.written_since(generation), true);
+
+    rsm.lock_shared();
+    generation = rsm.write_generation();
+    rsm.unlock_shared();
+    std::thread one(exclusive_with_value, 1);
+    one.join();
+    rsm.lock();
+    BOOST_CHECK_EQUAL(rsm.written_since(generation), true);
+    generation = rsm.write_generation();
+    rsm.downgrade();
+    BOOST_CHECK_EQUAL(rsm.written_since(generation), true);
+    rsm.unlock_shared();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,179 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "recursive_shared_mutex.h"
+#include "test_cxx_rsm.h"
+#include "timer.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(rsm_shard_tests, TestSetup)
+
+typedef rsm_sharded_mutex<4> four_shard_mutex;
+// every reader shares the one slot, the same code paths as with many cores on a small machine
+typedef rsm_sharded_mutex<1> one_shard_mutex;
+typedef basic_recursive_shared_mutex<rsm_reader_shards<4>, rsm_fairness_policy<rsm_fairness::reader_preferring> >
+    reader_preferring_shard_mutex;
+
+// shared ownership through a shard blocks writers from any other thread like shared ownership does
+template <class Mutex>
+void sharded_readers_block_writers()
+{
+    Mutex mutex;
+    mutex.lock_shared();
+    mutex.lock_shared();
+    std::atomic<bool> locked(false);
+    std::thread other([&mutex, &locked] {
+        BOOST_CHECK_EQUAL(mutex.try_lock(), false);
+        mutex.lock();
+        locked = true;
+        mutex.unlock();
+    });
+    MilliSleep(50);
+    BOOST_CHECK_EQUAL(locked.load(), false);
+    mutex.unlock_shared();
+    MilliSleep(50);
+    BOOST_CHECK_EQUAL(locked.load(), false);
+    mutex.unlock_shared();
+    other.join();
+    BOOST_CHECK_EQUAL(locked.load(), true);
+    BOOST_CHECK_EQUAL(mutex.try_lock(), true);
+    mutex.unlock();
+}
+
+BOOST_AUTO_TEST_CASE(rsm_sharded_readers_block_writers)
+{
+    sharded_readers_block_writers<four_shard_mutex>();
+    sharded_readers_block_writers<one_shard_mutex>();
+    sharded_readers_block_writers<reader_preferring_shard_mutex>();
+    sharded_readers_block_writers<sharded_recursive_shared_mutex>();
+}
+
+// a reader counted in a shard can be promoted, with other sharded readers it waits for them to leave
+BOOST_AUTO_TEST_CASE(rsm_sharded_promotion)
+{
+    four_shard_mutex mutex;
+    mutex.lock_shared();
+    BOOST_CHECK_EQUAL(mutex.try_promotion(), true);
+    mutex.unlock();
+    mutex.unlock_shared();
+
+    std::atomic<bool> reader_done(false);
+    std::atomic<bool> promoted(false);
+    mutex.lock_shared();
+    std::thread reader([&mutex, &reader_done] {
+        mutex.lock_shared();
+        MilliSleep(100);
+        reader_done = true;
+        mutex.unlock_shared();
+    });
+    MilliSleep(20);
+    std::thread candidate([&mutex, &reader_done, &promoted] {
+        mutex.lock_shared();
+        BOOST_CHECK_EQUAL(mutex.try_promotion(), true);
+        BOOST_CHECK_EQUAL(reader_done.load(), true);
+        promoted = true;
+        mutex.unlock();
+        mutex.unlock_shared();
+    });
+    MilliSleep(20);
+    // the main thread is a shared owner as well, the candidate also waits for us
+    BOOST_CHECK_EQUAL(promoted.load(), false);
+    MilliSleep(150);
+    BOOST_CHECK_EQUAL(promoted.load(), false);
+    mutex.unlock_shared();
+    reader.join();
+    candidate.join();
+    BOOST_CHECK_EQUAL(promoted.load(), true);
+}
+
+// update ownership taken on top of shared ownership from a shard gives the shard back when it ends
+BOOST_AUTO_TEST_CASE(rsm_sharded_update)
+{
+    four_shard_mutex mutex;
+    mutex.lock_shared();
+    BOOST_CHECK_EQUAL(mutex.try_lock_update(), true);
+    mutex.unlock_shared();
+    mutex.unlock_update();
+    std::thread writer([&mutex] {
+        BOOST_CHECK_EQUAL(mutex.try_lock(), true);
+        mutex.unlock();
+    });
+    writer.join();
+
+    mutex.lock_update();
+    mutex.lock_shared();
+    mutex.upgrade();
+    mutex.unlock();
+    mutex.unlock_shared();
+    mutex.unlock_update();
+    BOOST_CHECK_EQUAL(mutex.try_lock(), true);
+    mutex.unlock();
+}
+
+// readers never see a write half done and every writer gets in
+template <class Mutex>
+void sharded_stress()
+{
+    Mutex mutex;
+    uint64_t first = 0;
+    uint64_t second = 0;
+    std::atomic<uint64_t> torn(0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i)
+    {
+        threads.emplace_back([&mutex, &first, &second, &torn] {
+            for (int j = 0; j < 20000; ++j)
+            {
+                mutex.lock_shared();
+                if (first != second)
+                {
+                    torn++;
+                }
+                mutex.unlock_shared();
+            }
+        });
+    }
+    for (int i = 0; i < 2; ++i)
+    {
+        threads.emplace_back([&mutex, &first, &second] {
+            for (int j = 0; j < 2000; ++j)
+            {
+                if (j % 2 == 0)
+                {
+                    mutex.lock();
+                }
+                else
+                {
+                    mutex.lock_shared();
+                    mutex.try_promotion();
+                }
+                first++;
+                second++;
+                mutex.unlock();
+                if (j % 2 != 0)
+                {
+                    mutex.unlock_shared();
+                }
+            }
+        });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    BOOST_CHECK_EQUAL(torn.load(), 0);
+    BOOST_CHECK_EQUAL(first, 4000);
+    BOOST_CHECK_EQUAL(second, 4000);
+}
+
+BOOST_AUTO_TEST_CASE(rsm_sharded_stress)
+{
+    sharded_stress<four_shard_mutex>();
+    sharded_stress<one_shard_mutex>();
+    sharded_stress<reader_preferring_shard_mutex>();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
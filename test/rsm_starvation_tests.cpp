@@ -14,7 +14,7 @@ BOOST_FIXTURE_TEST_SUITE(rsm_starvation_tests, TestSetup)
 class rsm_watcher : public recursive_shared_mutex
 {
 public:
-    size_t get_shared_owners_count() { return _read_owner_ids.size(); }
+    size_t get_shared_owners_count() { return _state.load() & READER_MASK; }
 };
 
 rsm_watcher rsm;
@@ -95,4 +95,41 @@ BOOST_AUTO_TEST_CASE(rsm_test_starvation)
     rsm.unlock_shared();
 }
 
+void exclusive_with_value(int value)
+{
+    rsm.lock();
+    rsm_guarded_vector.push_back(value);
+    rsm.unlock();
+}
+
+/*
+ * threads waiting in lock() get exclusive ownership in the order they started
+ * waiting
+ */
+
+BOOST_AUTO_TEST_CASE(rsm_test_exclusive_fifo)
+{
+    rsm_guarded_vector.clear();
+
+    rsm.lock();
+    std::thread one(exclusive_with_value, 1);
+    MilliSleep(50);
+    std::thread two(exclusive_with_value, 2);
+    MilliSleep(50);
+    std::thread three(exclusive_with_value, 3);
+    MilliSleep(50);
+    rsm.unlock();
+
+    one.join();
+    two.join();
+    three.join();
+
+    rsm.lock_shared();
+    BOOST_CHECK_EQUAL(rsm_guarded_vector.size(), 3);
+    BOOST_CHECK_EQUAL(1, rsm_guarded_vector[0]);
+    BOOST_CHECK_EQUAL(2, rsm_guarded_vector[1]);
+    BOOST_CHECK_EQUAL(3, rsm_guarded_vector[2]);
+    rsm.unlock_shared();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,168 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rsm_striped.h"
+#include "test_cxx_rsm.h"
+#include "timer.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(rsm_striped_tests, TestSetup)
+
+BOOST_AUTO_TEST_CASE(rsm_striped_stripe_count)
+{
+    rsm_striped<16> fixed;
+    BOOST_CHECK_EQUAL(fixed.stripes(), 16);
+    rsm_striped<0> runtime(5);
+    BOOST_CHECK_EQUAL(runtime.stripes(), 5);
+    BOOST_CHECK_THROW(rsm_striped<0> empty(0), std::invalid_argument);
+
+    // keys with a stride of the stripe count still use every stripe
+    std::set<size_t> used;
+    for (uint64_t key = 0; key < 16 * 64; key += 16)
+    {
+        used.insert(fixed.stripe_of(key));
+    }
+    BOOST_CHECK_EQUAL(used.size(), 16);
+    BOOST_CHECK_EQUAL(fixed.stripe_of(std::string("key")), fixed.stripe_of(std::string("key")));
+    BOOST_CHECK(runtime.stripe_of(12345) < runtime.stripes());
+}
+
+// with one stripe every key collides, any mix of keys still works for one thread
+BOOST_AUTO_TEST_CASE(rsm_striped_colliding_keys)
+{
+    rsm_striped<1> striped;
+    striped.lock(1);
+    striped.lock(2);
+    striped.lock_shared(3);
+    std::thread other([&striped] {
+        BOOST_CHECK_EQUAL(striped.try_lock_shared(4), false);
+        BOOST_CHECK_EQUAL(striped.try_lock(5), false);
+    });
+    other.join();
+    striped.unlock_shared(3);
+    striped.unlock(2);
+    striped.unlock(1);
+
+    // shared ownership of one key, then a write to another one on the same stripe
+    striped.lock_shared(1);
+    striped.lock_shared(2);
+    BOOST_CHECK_EQUAL(striped.try_promotion(3), true);
+    striped.unlock(3);
+    striped.unlock_shared(2);
+    striped.unlock_shared(1);
+    BOOST_CHECK_EQUAL(striped.try_lock(4), true);
+    striped.unlock(4);
+}
+
+// keys on different stripes do not block each other
+BOOST_AUTO_TEST_CASE(rsm_striped_independent_stripes)
+{
+    rsm_striped<64> striped;
+    uint64_t other_key = 1;
+    while (striped.stripe_of(other_key) == striped.stripe_of(0))
+    {
+        other_key++;
+    }
+    striped.lock(0);
+    std::thread other([&striped, &other_key] {
+        BOOST_CHECK_EQUAL(striped.try_lock(other_key), true);
+        striped.unlock(other_key);
+        BOOST_CHECK_EQUAL(striped.try_lock_shared(0), false);
+    });
+    other.join();
+    striped.unlock(0);
+}
+
+// all stripes exclusive blocks every key until it is released
+BOOST_AUTO_TEST_CASE(rsm_striped_all_stripes)
+{
+    rsm_striped<0> striped(8);
+    striped.lock(3);
+    std::thread blocked([&striped] { BOOST_CHECK_EQUAL(striped.try_lock_all_stripes(), false); });
+    blocked.join();
+    striped.unlock(3);
+
+    std::atomic<bool> locked(false);
+    striped.lock_all_stripes();
+    std::thread reader([&striped, &locked] {
+        striped.lock_shared(42);
+        locked = true;
+        striped.unlock_shared(42);
+    });
+    MilliSleep(50);
+    BOOST_CHECK_EQUAL(locked.load(), false);
+    striped.unlock_all_stripes();
+    reader.join();
+    BOOST_CHECK_EQUAL(locked.load(), true);
+    BOOST_CHECK_EQUAL(striped.try_lock_all_stripes(), true);
+    striped.unlock_all_stripes();
+}
+
+// values guarded by their stripe stay consistent while the whole table is rewritten now and then
+BOOST_AUTO_TEST_CASE(rsm_striped_stress)
+{
+    rsm_striped<4> striped;
+    std::vector<uint64_t> first(32, 0);
+    std::vector<uint64_t> second(32, 0);
+    std::atomic<uint64_t> torn(0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 6; ++i)
+    {
+        threads.emplace_back([&striped, &first, &second, &torn, i] {
+            for (int j = 0; j < 4000; ++j)
+            {
+                const size_t key = (i * 7 + j) % first.size();
+                if (j % 500 == 0)
+                {
+                    striped.lock_all_stripes();
+                    for (size_t k = 0; k < first.size(); ++k)
+                    {
+                        first[k]++;
+                        second[k]++;
+                    }
+                    striped.unlock_all_stripes();
+                }
+                else if (j % 3 == 0)
+                {
+                    striped.lock_shared(key);
+                    if (striped.try_promotion(key))
+                    {
+                        first[key]++;
+                        second[key]++;
+                        striped.unlock(key);
+                    }
+                    striped.unlock_shared(key);
+                }
+                else
+                {
+                    striped.lock_shared(key);
+                    if (first[key] != second[key])
+                    {
+                        torn++;
+                    }
+                    striped.unlock_shared(key);
+                }
+            }
+        });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    BOOST_CHECK_EQUAL(torn.load(), 0);
+    for (size_t k = 0; k < first.size(); ++k)
+    {
+        BOOST_CHECK_EQUAL(first[k], second[k]);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,133 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "recursive_shared_mutex.h"
+#include "test_cxx_rsm.h"
+#include "timer.h"
+
+#include <shared_mutex>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(rsm_timed_tests, TestSetup)
+
+recursive_shared_mutex rsm;
+
+void hold_exclusive()
+{
+    rsm.lock();
+    MilliSleep(500);
+    rsm.unlock();
+}
+
+void hold_shared()
+{
+    rsm.lock_shared();
+    MilliSleep(500);
+    rsm.unlock_shared();
+}
+
+void timed_exclusive_fail() { BOOST_CHECK_EQUAL(rsm.try_lock_for(std::chrono::milliseconds(50)), false); }
+void timed_exclusive_pass()
+{
+    BOOST_CHECK_EQUAL(rsm.try_lock_for(std::chrono::milliseconds(2000)), true);
+    rsm.unlock();
+}
+
+void timed_shared_fail() { BOOST_CHECK_EQUAL(rsm.try_lock_shared_for(std::chrono::milliseconds(50)), false); }
+void timed_shared_pass()
+{
+    BOOST_CHECK_EQUAL(rsm.try_lock_shared_for(std::chrono::milliseconds(2000)), true);
+    rsm.unlock_shared();
+}
+
+// timed exclusive and shared locking while another thread has exclusive ownership
+BOOST_AUTO_TEST_CASE(rsm_timed_lock_while_exclusive)
+{
+    std::thread one(hold_exclusive);
+    MilliSleep(100);
+    std::thread two(timed_exclusive_fail);
+    two.join();
+    std::thread three(timed_shared_fail);
+    three.join();
+    // these outlast the exclusive ownership
+    std::thread four(timed_exclusive_pass);
+    std::thread five(timed_shared_pass);
+    one.join();
+    four.join();
+    five.join();
+
+    // recursive and uncontended timed locks succeed right away
+    BOOST_CHECK_EQUAL(rsm.try_lock_until(std::chrono::system_clock::now()), true);
+    BOOST_CHECK_EQUAL(rsm.try_lock_until(std::chrono::steady_clock::now()), true);
+    rsm.unlock();
+    rsm.unlock();
+    BOOST_CHECK_EQUAL(rsm.try_lock_shared_until(std::chrono::steady_clock::now()), true);
+    BOOST_CHECK_EQUAL(rsm.try_lock_shared_for(std::chrono::milliseconds(0)), true);
+    rsm.unlock_shared();
+    rsm.unlock_shared();
+}
+
+// a writer that gives up must stop blocking the readers that queued behind it
+BOOST_AUTO_TEST_CASE(rsm_timed_lock_gives_up_for_readers)
+{
+    std::thread one(hold_shared);
+    MilliSleep(100);
+    // blocks new readers while it waits for thread one
+    std::thread two(timed_exclusive_fail);
+    MilliSleep(10);
+    // must get in once thread two gave up, long before thread one is done
+    int64_t start = GetTimeMillis();
+    rsm.lock_shared();
+    BOOST_CHECK(GetTimeMillis() - start < 400);
+    rsm.unlock_shared();
+    one.join();
+    two.join();
+}
+
+// the mutex meets the SharedTimedMutex requirements used by std::shared_lock
+BOOST_AUTO_TEST_CASE(rsm_timed_shared_lock)
+{
+    std::thread one(hold_exclusive);
+    MilliSleep(100);
+    {
+        std::shared_lock<recursive_shared_mutex> lock(rsm, std::chrono::milliseconds(50));
+        BOOST_CHECK_EQUAL(lock.owns_lock(), false);
+    }
+    {
+        std::shared_lock<recursive_shared_mutex> lock(rsm, std::defer_lock);
+        BOOST_CHECK_EQUAL(lock.try_lock_for(std::chrono::milliseconds(2000)), true);
+    }
+    one.join();
+}
+
+void promote_fail()
+{
+    rsm.lock_shared();
+    BOOST_CHECK_EQUAL(rsm.try_promotion_for(std::chrono::milliseconds(200)), false);
+    // we still have our shared ownership after giving up
+    MilliSleep(100);
+    rsm.unlock_shared();
+}
+
+// a promotion that times out gives up the promotion slot and lets in the readers it blocked
+BOOST_AUTO_TEST_CASE(rsm_timed_promotion)
+{
+    // keep the promotion from succeeding
+    rsm.lock_shared();
+    std::thread one(promote_fail);
+    MilliSleep(50);
+    // blocked by the promotion candidate until it gives up
+    std::thread two(timed_shared_pass);
+    two.join();
+    one.join();
+
+    // the slot is free again, nobody else has shared ownership so we get promoted right away
+    BOOST_CHECK_EQUAL(rsm.try_promotion_for(std::chrono::milliseconds(50)), true);
+    rsm.unlock();
+    rsm.unlock_shared();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,171 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Bitcoin Unlimited developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "recursive_shared_mutex.h"
+#include "test_cxx_rsm.h"
+#include "timer.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(rsm_update_tests, TestSetup)
+
+recursive_shared_mutex rsm;
+std::vector<int> rsm_guarded_vector;
+
+void try_lock_fail() { BOOST_CHECK_EQUAL(rsm.try_lock(), false); }
+void try_lock_pass()
+{
+    BOOST_CHECK_EQUAL(rsm.try_lock(), true);
+    rsm.unlock();
+}
+void try_update_fail() { BOOST_CHECK_EQUAL(rsm.try_lock_update(), false); }
+void try_shared_pass()
+{
+    BOOST_CHECK_EQUAL(rsm.try_lock_shared(), true);
+    rsm.unlock_shared();
+}
+void try_promotion_fail()
+{
+    rsm.lock_shared();
+    BOOST_CHECK_EQUAL(rsm.try_promotion(), false);
+    rsm.unlock_shared();
+}
+
+void shared_with_value(int value)
+{
+    rsm.lock_shared();
+    MilliSleep(200);
+    rsm_guarded_vector.push_back(value);
+    rsm.unlock_shared();
+}
+
+void update_with_value(int value)
+{
+    rsm.lock_update();
+    rsm_guarded_vector.push_back(value);
+    MilliSleep(100);
+    rsm.unlock_update();
+}
+
+// update ownership is shared with readers but not with other update owners or writers
+BOOST_AUTO_TEST_CASE(rsm_update_ownership)
+{
+    rsm.lock_update();
+    std::thread one(try_shared_pass);
+    one.join();
+    std::thread two(try_update_fail);
+    two.join();
+    std::thread three(try_lock_fail);
+    three.join();
+    // another reader can not take the promotion slot away from the update owner
+    std::thread four(try_promotion_fail);
+    four.join();
+    rsm.unlock_update();
+
+    std::thread five(try_lock_pass);
+    five.join();
+}
+
+// recursive update locks and shared locks taken while holding update ownership
+BOOST_AUTO_TEST_CASE(rsm_update_recursion)
+{
+    rsm.lock_update();
+    rsm.lock_update();
+    rsm.lock_shared();
+    BOOST_CHECK_EQUAL(rsm.try_lock_update(), true);
+    rsm.unlock_update();
+    rsm.unlock_update();
+    std::thread one(try_update_fail);
+    one.join();
+    rsm.unlock_update();
+    // the shared lock is still held
+    std::thread two(try_lock_fail);
+    two.join();
+    rsm.unlock_shared();
+
+    // the exclusive owner can lock for update, it counts as a shared lock
+    rsm.lock();
+    rsm.lock_update();
+    rsm.unlock();
+    std::thread three(try_lock_fail);
+    three.join();
+    rsm.unlock_update();
+    std::thread four(try_lock_pass);
+    four.join();
+}
+
+// upgrade waits for the other readers and keeps update ownership after unlock
+BOOST_AUTO_TEST_CASE(rsm_update_upgrade)
+{
+    rsm_guarded_vector.clear();
+    std::thread one(shared_with_value, 1);
+    MilliSleep(50);
+    rsm.lock_update();
+    rsm.upgrade();
+    rsm_guarded_vector.push_back(2);
+    rsm.unlock();
+    std::thread two(try_update_fail);
+    two.join();
+    rsm.unlock_update();
+    one.join();
+
+    BOOST_CHECK_EQUAL(rsm_guarded_vector.size(), 2);
+    BOOST_CHECK_EQUAL(rsm_guarded_vector[0], 1);
+    BOOST_CHECK_EQUAL(rsm_guarded_vector[1], 2);
+}
+
+// lock_update waits for the current update owner
+BOOST_AUTO_TEST_CASE(rsm_update_waits_for_update_owner)
+{
+    rsm_guarded_vector.clear();
+    std::thread one(update_with_value, 1);
+    MilliSleep(50);
+    rsm.lock_update();
+    rsm_guarded_vector.push_back(2);
+    rsm.unlock_update();
+    one.join();
+
+    BOOST_CHECK_EQUAL(rsm_guarded_vector.size(), 2);
+    BOOST_CHECK_EQUAL(rsm_guarded_vector[0], 1);
+    BOOST_CHECK_EQUAL(rsm_guarded_vector[1], 2);
+}
+
+// a thread that parked in lock_update while the mutex was held exclusively is woken by downgrade
+BOOST_AUTO_TEST_CASE(rsm_update_wakes_after_downgrade)
+{
+    rsm_guarded_vector.clear();
+    rsm.lock();
+    std::thread one(update_with_value, 1);
+    MilliSleep(50);
+    rsm.downgrade();
+    rsm.unlock_shared();
+    one.join();
+
+    BOOST_CHECK_EQUAL(rsm_guarded_vector.size(), 1);
+    BOOST_CHECK_EQUAL(rsm_guarded_vector[0], 1);
+}
+
+// the guard releases exclusive and update ownership when it goes out of scope
+BOOST_AUTO_TEST_CASE(rsm_update_lock_guard)
+{
+    {
+        rsm_update_lock<recursive_shared_mutex> lock(rsm);
+        BOOST_CHECK(lock.owns_lock());
+        std::thread one(try_update_fail);
+        one.join();
+        {
+            rsm_update_lock<recursive_shared_mutex> second(rsm, std::try_to_lock);
+            BOOST_CHECK(second.owns_lock());
+        }
+        lock.upgrade();
+        BOOST_CHECK(lock.upgraded());
+        std::thread two(try_update_fail);
+        two.join();
+    }
+    std::thread three(try_lock_pass);
+    three.join();
+}
+
+BOOST_AUTO_TEST_SUITE_END()